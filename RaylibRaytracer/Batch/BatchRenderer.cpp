@@ -0,0 +1,243 @@
+#include "BatchRenderer.h"
+#include "ImageWriter.h"
+#include "JobQueue.h"
+#include "../Graphics/TracingEngine.h"
+#include "../Graphics/Profiler.h"
+
+#include <external/glad.h>
+#include <raylib.h>
+#include <iostream>
+#include <cstring>
+#include <thread>
+
+bool BatchRenderer::IsBatchCommand(int argc, char** argv)
+{
+	return argc > 1 && strcmp(argv[1], "--batch") == 0;
+}
+
+void BatchRenderer::PrintUsage()
+{
+	std::cout << "usage: RaylibRaytracer --batch <scene> [options]\n"
+		"  --output <path>     output images, #### is replaced by the frame number, .exr or .png (render_####.png)\n"
+		"  --width <pixels>    override the scene resolution\n"
+		"  --height <pixels>\n"
+		"  --samples <spp>     samples per pixel per frame\n"
+		"  --time <seconds>    stop a frame early once this budget is spent, output is then no longer reproducible\n"
+		"  --frames <count>\n"
+		"  --seed <int>        base seed, frame n is traced with seed + n\n"
+		"  --trace <path>      write a chrome trace of the whole run\n";
+}
+
+bool BatchRenderer::ParseArguments(int argc, char** argv, BatchOptions* options)
+{
+	return options->render.ParseArguments(argc, argv, [options](const std::string& option, const char* value)
+	{
+		if (option == "--trace") options->tracePath = value;
+		else if (option == "--frames") options->frames = atoi(value);
+		else if (option == "--time") options->timeBudget = atof(value);
+		else return false;
+
+		return true;
+	});
+}
+
+std::string BatchRenderer::FormatOutputPath(const std::string& pattern, int frame, int numFrames)
+{
+	size_t begin = pattern.find('#');
+
+	if (begin == std::string::npos)
+	{
+		if (numFrames == 1)
+		{
+			return pattern;
+		}
+
+		// several frames need distinct names even without a placeholder
+		size_t extension = pattern.rfind('.');
+		return pattern.substr(0, extension) + TextFormat("_%04i", frame) + (extension == std::string::npos ? "" : pattern.substr(extension));
+	}
+
+	size_t end = pattern.find_first_not_of('#', begin);
+	int digits = (end == std::string::npos ? pattern.size() : end) - begin;
+
+	return pattern.substr(0, begin) + TextFormat("%0*i", digits, frame) + (end == std::string::npos ? "" : pattern.substr(end));
+}
+
+int BatchRenderer::RenderFrame(SceneDescription* scene, int frame)
+{
+	RenderSettings* settings = &scene->settings;
+
+	Camera camera = scene->GetCamera(frame);
+
+	// every frame starts from the same seed no matter how or where it was rendered before
+	TracingEngine::seed = settings->seed + frame;
+	TracingEngine::ResetAccumulation();
+
+	int passes = (settings->samples + settings->raysPerPixel - 1) / settings->raysPerPixel;
+	double start = GetTime();
+	int pass = 0;
+
+	while (pass < passes)
+	{
+		Profiler::BeginFrame();
+
+		TracingEngine::UploadData(&camera);
+		TracingEngine::Accumulate();
+		pass++;
+
+		if (settings->timeBudget > 0)
+		{
+			// passes are queued asynchronously, wait for them so the budget measures GPU work
+			glFinish();
+
+			if (GetTime() - start >= settings->timeBudget)
+			{
+				break;
+			}
+		}
+	}
+
+	return pass * settings->raysPerPixel;
+}
+
+int BatchRenderer::Run(int argc, char** argv)
+{
+	BatchOptions options;
+
+	if (!ParseArguments(argc, argv, &options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	SceneDescription scene;
+
+	if (!scene.Parse(options.render.scenePath.c_str()))
+	{
+		return 1;
+	}
+
+	RenderSettings* settings = &scene.settings;
+	options.render.Apply(settings);
+	if (options.frames > 0) settings->frames = options.frames;
+	if (options.timeBudget >= 0) settings->timeBudget = options.timeBudget;
+
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(settings->width, settings->height, "raylib raytracer batch");
+
+	TracingEngine::Initialize(Vector2((float)settings->width, (float)settings->height), settings->maxBounces, settings->raysPerPixel, settings->blur);
+	TracingEngine::skyMaterial = scene.sky;
+	TracingEngine::denoise = true;
+	TracingEngine::pause = false;
+
+	if (!scene.Load())
+	{
+		scene.Unload();
+		TracingEngine::Unload();
+		CloseWindow();
+		return 1;
+	}
+
+	TracingEngine::UploadStaticData();
+
+	if (!options.tracePath.empty())
+	{
+		Profiler::BeginCapture();
+	}
+
+	// one frame of geometry ahead of the tracer, a couple of images behind it
+	JobQueue<FrameJob> buildQueue(1);
+	JobQueue<OutputJob> outputQueue(2);
+
+	int numFrames = settings->frames;
+	bool animated = scene.IsAnimated();
+
+	std::thread builder([&]()
+	{
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			FrameJob job = { frame, frame == 0 || animated };
+
+			if (job.hasGeometry)
+			{
+				job.geometry = scene.BuildGeometry(frame);
+			}
+
+			if (!buildQueue.Push(std::move(job)))
+			{
+				break;
+			}
+		}
+
+		buildQueue.Close();
+	});
+
+	bool failed = false;
+
+	std::thread writer([&]()
+	{
+		OutputJob job;
+
+		while (outputQueue.Pop(&job))
+		{
+			PROFILE_SCOPE("WriteImage");
+
+			if (!ImageWriter::Write(job.path.c_str(), settings->width, settings->height, job.pixels))
+			{
+				TraceLog(LOG_ERROR, "BATCH: [%s] Failed to write frame %i", job.path.c_str(), job.frame);
+				failed = true;
+			}
+		}
+	});
+
+	bool aborted = false;
+	double runStart = GetTime();
+	long long totalSamples = 0;
+
+	FrameJob job;
+
+	while (buildQueue.Pop(&job))
+	{
+		if (job.hasGeometry && !TracingEngine::UploadGeometry(std::move(job.geometry)))
+		{
+			TraceLog(LOG_ERROR, "BATCH: Frame %i does not fit the tracing buffers", job.frame);
+			aborted = true;
+			break;
+		}
+
+		double frameStart = GetTime();
+
+		int samples = RenderFrame(&scene, job.frame);
+		std::vector<float> pixels = TracingEngine::ReadAccumulation();
+
+		double frameTime = GetTime() - frameStart;
+		double paths = (double)settings->width * settings->height * samples;
+		totalSamples += samples;
+
+		TraceLog(LOG_INFO, "BATCH: Frame %i/%i, %i spp in %.2f s (%.1f Mpaths/s)", job.frame + 1, numFrames, samples, frameTime, paths / frameTime / 1000000.0);
+
+		outputQueue.Push({ job.frame, FormatOutputPath(options.render.outputPath, job.frame, numFrames), std::move(pixels) });
+	}
+
+	// an aborted run leaves the builder blocked on a full queue
+	buildQueue.Close();
+	builder.join();
+	outputQueue.Close();
+	writer.join();
+
+	double runTime = GetTime() - runStart;
+	double totalPaths = (double)settings->width * settings->height * totalSamples;
+
+	TraceLog(LOG_INFO, "BATCH: %i frames in %.2f s, %.3f frames/s, %.1f Mpaths/s", numFrames, runTime, numFrames / runTime, totalPaths / runTime / 1000000.0);
+
+	if (!options.tracePath.empty())
+	{
+		Profiler::EndCapture(options.tracePath.c_str());
+	}
+
+	scene.Unload();
+	TracingEngine::Unload();
+	CloseWindow();
+
+	return failed || aborted ? 1 : 0;
+}
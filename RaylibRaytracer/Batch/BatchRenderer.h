@@ -0,0 +1,45 @@
+#pragma once
+
+#include "SceneDescription.h"
+
+#include <string>
+#include <vector>
+
+struct BatchOptions
+{
+	RenderOptions render = { .outputPath = "render_####.png" };    // the output path is a pattern, see FormatOutputPath
+	std::string tracePath;
+
+	// -1 keeps the value from the scene file
+	int frames = -1;
+	float timeBudget = -1;
+};
+
+struct FrameJob
+{
+	int frame;
+	bool hasGeometry;
+	SceneGeometry geometry;
+};
+
+struct OutputJob
+{
+	int frame;
+	std::string path;
+	std::vector<float> pixels;
+};
+
+// Unattended rendering of a scene file to numbered images. Geometry and BVHs for the next frame are built on a
+// worker thread while the current one traces, and images are written on another so the GPU never waits on disk.
+class BatchRenderer
+{
+private:
+	static bool ParseArguments(int argc, char** argv, BatchOptions* options);
+	static void PrintUsage();
+	static std::string FormatOutputPath(const std::string& pattern, int frame, int numFrames);
+	static int RenderFrame(SceneDescription* scene, int frame);
+
+public:
+	static bool IsBatchCommand(int argc, char** argv);
+	static int Run(int argc, char** argv);
+};
@@ -0,0 +1,130 @@
+#include "ImageWriter.h"
+
+#include <raylib.h>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+static void WriteBytes(std::ofstream* file, const void* data, size_t size)
+{
+	file->write((const char*)data, size);
+}
+
+static void WriteInt(std::ofstream* file, int32_t value)
+{
+	WriteBytes(file, &value, sizeof(value));
+}
+
+static void WriteAttribute(std::ofstream* file, const char* name, const char* type, int32_t size, const void* value)
+{
+	WriteBytes(file, name, strlen(name) + 1);
+	WriteBytes(file, type, strlen(type) + 1);
+	WriteInt(file, size);
+	WriteBytes(file, value, size);
+}
+
+bool ImageWriter::WriteEXR(const char* path, int width, int height, const std::vector<float>& rgba)
+{
+	// single part scanline OpenEXR, 32 bit float channels without compression, little endian like the format itself
+	std::ofstream file(path, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	const unsigned char magic[] = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+	WriteBytes(&file, magic, sizeof(magic));
+
+	// channels are stored in alphabetical order
+	const char* channelNames[] = { "B", "G", "R" };
+	const int channelOffsets[] = { 2, 1, 0 };
+
+	std::vector<unsigned char> channels;
+	for (int c = 0; c < 3; c++)
+	{
+		int32_t channel[4] = { 2, 0, 1, 1 };    // FLOAT, pLinear + reserved, xSampling, ySampling
+		channels.insert(channels.end(), channelNames[c], channelNames[c] + 2);
+		channels.insert(channels.end(), (unsigned char*)channel, (unsigned char*)channel + sizeof(channel));
+	}
+	channels.push_back(0);
+
+	int32_t window[4] = { 0, 0, width - 1, height - 1 };
+	unsigned char compression = 0;
+	unsigned char lineOrder = 0;
+	float pixelAspectRatio = 1;
+	float screenWindowCenter[2] = { 0, 0 };
+	float screenWindowWidth = 1;
+
+	WriteAttribute(&file, "channels", "chlist", channels.size(), channels.data());
+	WriteAttribute(&file, "compression", "compression", 1, &compression);
+	WriteAttribute(&file, "dataWindow", "box2i", sizeof(window), window);
+	WriteAttribute(&file, "displayWindow", "box2i", sizeof(window), window);
+	WriteAttribute(&file, "lineOrder", "lineOrder", 1, &lineOrder);
+	WriteAttribute(&file, "pixelAspectRatio", "float", sizeof(float), &pixelAspectRatio);
+	WriteAttribute(&file, "screenWindowCenter", "v2f", sizeof(screenWindowCenter), screenWindowCenter);
+	WriteAttribute(&file, "screenWindowWidth", "float", sizeof(float), &screenWindowWidth);
+	file.put(0);
+
+	int32_t lineSize = width * 3 * sizeof(float);
+	uint64_t offset = (uint64_t)file.tellp() + height * sizeof(uint64_t);
+
+	for (int y = 0; y < height; y++)
+	{
+		WriteBytes(&file, &offset, sizeof(offset));
+		offset += 2 * sizeof(int32_t) + lineSize;
+	}
+
+	std::vector<float> line(width * 3);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				line[c * width + x] = rgba[(y * width + x) * 4 + channelOffsets[c]];
+			}
+		}
+
+		WriteInt(&file, y);
+		WriteInt(&file, lineSize);
+		WriteBytes(&file, line.data(), lineSize);
+	}
+
+	return file.good();
+}
+
+bool ImageWriter::WritePNG(const char* path, int width, int height, const std::vector<float>& rgba)
+{
+	std::vector<unsigned char> pixels(width * height * 4);
+
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		pixels[i] = (i % 4 == 3) ? 255 : (unsigned char)(std::clamp(rgba[i], 0.0f, 1.0f) * 255 + 0.5f);
+	}
+
+	Image image = { pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+
+	return ExportImage(image, path);
+}
+
+bool ImageWriter::Write(const char* path, int width, int height, const std::vector<float>& rgba)
+{
+	std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+	if (!directory.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+	}
+
+	if (IsFileExtension(path, ".exr"))
+	{
+		return WriteEXR(path, width, height, rgba);
+	}
+
+	return WritePNG(path, width, height, rgba);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+class ImageWriter
+{
+private:
+	static bool WriteEXR(const char* path, int width, int height, const std::vector<float>& rgba);
+	static bool WritePNG(const char* path, int width, int height, const std::vector<float>& rgba);
+
+public:
+	// picks the format from the extension, .exr keeps the full float radiance, anything else is clamped to 8 bit
+	static bool Write(const char* path, int width, int height, const std::vector<float>& rgba);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// Bounded blocking FIFO handing jobs from one thread to another, Push blocks while full and Pop while empty
+template<typename T>
+class JobQueue
+{
+private:
+	std::deque<T> jobs;
+	std::mutex mutex;
+	std::condition_variable changed;
+	size_t capacity;
+	bool closed = false;
+
+public:
+	JobQueue(size_t capacity) : capacity(capacity) {}
+
+	bool Push(T job)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return closed || jobs.size() < capacity; });
+
+		if (closed)
+		{
+			return false;
+		}
+
+		jobs.push_back(std::move(job));
+		changed.notify_all();
+		return true;
+	}
+
+	// returns false once the queue is closed and drained
+	bool Pop(T* job)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return closed || !jobs.empty(); });
+
+		if (jobs.empty())
+		{
+			return false;
+		}
+
+		*job = std::move(jobs.front());
+		jobs.pop_front();
+		changed.notify_all();
+		return true;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		changed.notify_all();
+	}
+};
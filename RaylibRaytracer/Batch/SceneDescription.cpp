@@ -0,0 +1,395 @@
+#include "SceneDescription.h"
+
+#include <raymath.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+static Color ReadColor(std::istringstream* line)
+{
+	int r = 0, g = 0, b = 0;
+	*line >> r >> g >> b;
+	return Color{ (unsigned char)r, (unsigned char)g, (unsigned char)b, 255 };
+}
+
+static Vector3 ReadVector3(std::istringstream* line)
+{
+	Vector3 v = {};
+	*line >> v.x >> v.y >> v.z;
+	return v;
+}
+
+static Vector4 ReadVector4(std::istringstream* line)
+{
+	Vector4 v = {};
+	*line >> v.x >> v.y >> v.z >> v.w;
+	return v;
+}
+
+bool RenderOptions::ParseArguments(int argc, char** argv, const std::function<bool(const std::string& option, const char* value)>& parseOption)
+{
+	if (argc < 3)
+	{
+		return false;
+	}
+
+	scenePath = argv[2];
+
+	for (int i = 3; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			std::cout << "missing value for " << argv[i] << "\n";
+			return false;
+		}
+
+		std::string option = argv[i];
+		const char* value = argv[++i];
+
+		if (option == "--output") outputPath = value;
+		else if (option == "--width") width = atoi(value);
+		else if (option == "--height") height = atoi(value);
+		else if (option == "--samples") samples = atoi(value);
+		else if (option == "--seed") seed = atoi(value);
+		else if (!parseOption(option, value))
+		{
+			std::cout << "unknown option " << option << "\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void RenderOptions::Apply(RenderSettings* settings)
+{
+	if (width > 0) settings->width = width;
+	if (height > 0) settings->height = height;
+	if (samples > 0) settings->samples = samples;
+	if (seed >= 0) settings->seed = seed;
+}
+
+bool SceneDescription::Parse(const char* path)
+{
+	std::ifstream file(path);
+
+	if (!file.is_open())
+	{
+		TraceLog(LOG_ERROR, "SCENE: [%s] Failed to open scene file", path);
+		return false;
+	}
+
+	std::string text;
+	int lineNumber = 0;
+
+	while (std::getline(file, text))
+	{
+		lineNumber++;
+
+		text = text.substr(0, text.find('#'));
+
+		std::istringstream line(text);
+		std::string keyword;
+
+		if (!(line >> keyword))
+		{
+			continue;
+		}
+
+		if (keyword == "resolution") line >> settings.width >> settings.height;
+		else if (keyword == "samples") line >> settings.samples;
+		else if (keyword == "rays") line >> settings.raysPerPixel;
+		else if (keyword == "bounces") line >> settings.maxBounces;
+		else if (keyword == "blur") line >> settings.blur;
+		else if (keyword == "frames") line >> settings.frames;
+		else if (keyword == "seed") line >> settings.seed;
+		else if (keyword == "time") line >> settings.timeBudget;
+		else if (keyword == "sky")
+		{
+			sky.skyColorZenith = ReadColor(&line);
+			sky.skyColorHorizon = ReadColor(&line);
+			sky.groundColor = ReadColor(&line);
+			sky.sunColor = ReadColor(&line);
+			sky.sunDirection = ReadVector3(&line);
+			line >> sky.sunFocus >> sky.sunIntensity;
+		}
+		else if (keyword == "material")
+		{
+			SceneMaterial material = {};
+			line >> material.name;
+			material.material.color = ReadVector4(&line);
+			material.material.emission = ReadVector4(&line);
+			material.material.e_s_b_b = ReadVector4(&line);
+
+			// the texture is optional, only the fields before it decide whether the statement is malformed
+			bool complete = !line.fail();
+			line >> material.texture;
+			if (complete) line.clear();
+
+			materials.push_back(material);
+		}
+		else if (keyword == "model" || keyword == "plane" || keyword == "cube")
+		{
+			SceneObject object = {};
+			object.indexed = true;
+
+			if (keyword == "model")
+			{
+				object.type = SCENE_OBJECT_MODEL;
+				line >> object.path >> object.material >> object.indexed;
+			}
+			else if (keyword == "plane")
+			{
+				object.type = SCENE_OBJECT_PLANE;
+				line >> object.size.x >> object.size.z >> object.material;
+			}
+			else
+			{
+				object.type = SCENE_OBJECT_CUBE;
+				object.size = ReadVector3(&line);
+				line >> object.material;
+			}
+
+			line >> object.bvhDepth;
+
+			// SplitNode only stops at the requested depth, anything deeper cannot fit the node buffer anyway
+			if (object.bvhDepth < 0 || object.bvhDepth > MAX_BVH_DEPTH)
+			{
+				line.setstate(std::ios::failbit);
+			}
+
+			objects.push_back(object);
+		}
+		else if (keyword == "transform")
+		{
+			if (objects.empty())
+			{
+				TraceLog(LOG_ERROR, "SCENE: [%s:%i] transform before any object", path, lineNumber);
+				return false;
+			}
+
+			TransformKey key = {};
+			line >> key.frame;
+			key.translation = ReadVector3(&line);
+			key.rotation = ReadVector3(&line);
+			objects.back().transformKeys.push_back(key);
+		}
+		else if (keyword == "camera")
+		{
+			CameraKey key = {};
+			line >> key.frame;
+			key.position = ReadVector3(&line);
+			key.target = ReadVector3(&line);
+			line >> key.fovy;
+			cameraKeys.push_back(key);
+		}
+		else
+		{
+			TraceLog(LOG_ERROR, "SCENE: [%s:%i] Unknown statement '%s'", path, lineNumber, keyword.c_str());
+			return false;
+		}
+
+		if (line.fail())
+		{
+			TraceLog(LOG_ERROR, "SCENE: [%s:%i] Malformed '%s' statement", path, lineNumber, keyword.c_str());
+			return false;
+		}
+	}
+
+	if (settings.width <= 0 || settings.height <= 0 || settings.samples <= 0 || settings.raysPerPixel <= 0 || settings.maxBounces < 0 || settings.frames <= 0)
+	{
+		TraceLog(LOG_ERROR, "SCENE: [%s] Resolution, samples, rays and frames must be positive", path);
+		return false;
+	}
+
+	auto byFrame = [](const auto& a, const auto& b) { return a.frame < b.frame; };
+
+	std::stable_sort(cameraKeys.begin(), cameraKeys.end(), byFrame);
+
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		std::stable_sort(objects[i].transformKeys.begin(), objects[i].transformKeys.end(), byFrame);
+	}
+
+	return true;
+}
+
+bool SceneDescription::Load()
+{
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		SceneObject* object = &objects[i];
+
+		auto material = std::find_if(materials.begin(), materials.end(), [object](const SceneMaterial& m) { return m.name == object->material; });
+
+		bool ownMaterials = object->type == SCENE_OBJECT_MODEL && object->material == "*";
+
+		if (material == materials.end() && !ownMaterials)
+		{
+			TraceLog(LOG_ERROR, "SCENE: Unknown material '%s'", object->material.c_str());
+			return false;
+		}
+
+		switch (object->type)
+		{
+		case SCENE_OBJECT_MODEL:
+			object->model = LoadModel(object->path.c_str());
+			break;
+		case SCENE_OBJECT_PLANE:
+			object->model = LoadModelFromMesh(GenMeshPlane(object->size.x, object->size.z, 1, 1));
+			break;
+		case SCENE_OBJECT_CUBE:
+			object->model = LoadModelFromMesh(GenMeshCube(object->size.x, object->size.y, object->size.z));
+			break;
+		}
+
+		if (object->model.meshCount == 0)
+		{
+			TraceLog(LOG_ERROR, "SCENE: [%s] Failed to load model", object->path.c_str());
+			return false;
+		}
+
+		if (ownMaterials)
+		{
+			object->modelMaterials = TracingEngine::AddRaylibMaterials(object->model);
+
+			if (object->modelMaterials.empty() || std::find(object->modelMaterials.begin(), object->modelMaterials.end(), -1) != object->modelMaterials.end())
+			{
+				TraceLog(LOG_ERROR, "SCENE: [%s] Failed to add the model's materials", object->path.c_str());
+				return false;
+			}
+		}
+	}
+
+	// register materials once all objects resolved, so each is uploaded a single time
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		if (!materials[i].texture.empty())
+		{
+			Image image = LoadImage(materials[i].texture.c_str());
+			materials[i].material.textureIndex = TracingEngine::AddTexture(image);
+			UnloadImage(image);
+
+			if (materials[i].material.textureIndex == 0)
+			{
+				TraceLog(LOG_ERROR, "SCENE: [%s] Failed to load texture", materials[i].texture.c_str());
+				return false;
+			}
+		}
+
+		int materialIndex = TracingEngine::AddMaterial(materials[i].material);
+
+		if (materialIndex < 0)
+		{
+			return false;
+		}
+
+		for (size_t o = 0; o < objects.size(); o++)
+		{
+			if (objects[o].material == materials[i].name)
+			{
+				objects[o].materialIndex = materialIndex;
+			}
+		}
+	}
+
+	return true;
+}
+
+void SceneDescription::Unload()
+{
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		if (objects[i].model.meshCount > 0)
+		{
+			UnloadModel(objects[i].model);
+		}
+	}
+}
+
+bool SceneDescription::IsAnimated()
+{
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		if (objects[i].transformKeys.size() > 1)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+Camera SceneDescription::GetCamera(int frame)
+{
+	Camera camera = Camera();
+	camera.position = Vector3(15, 8, 15);
+	camera.target = Vector3(0, 0.5f, 0);
+	camera.up = Vector3(0, 1, 0);
+	camera.fovy = 45;
+	camera.projection = CAMERA_PERSPECTIVE;
+
+	if (cameraKeys.empty())
+	{
+		return camera;
+	}
+
+	size_t next = 0;
+	while (next < cameraKeys.size() && cameraKeys[next].frame <= frame) next++;
+
+	CameraKey* a = &cameraKeys[next == 0 ? 0 : next - 1];
+	CameraKey* b = &cameraKeys[next == cameraKeys.size() ? next - 1 : next];
+	float t = a->frame == b->frame ? 0 : (float)(frame - a->frame) / (b->frame - a->frame);
+
+	camera.position = Vector3Lerp(a->position, b->position, t);
+	camera.target = Vector3Lerp(a->target, b->target, t);
+	camera.fovy = Lerp(a->fovy, b->fovy, t);
+
+	return camera;
+}
+
+Matrix SceneDescription::InterpolateTransform(std::vector<TransformKey>* keys, int frame)
+{
+	if (keys->empty())
+	{
+		return MatrixIdentity();
+	}
+
+	size_t next = 0;
+	while (next < keys->size() && (*keys)[next].frame <= frame) next++;
+
+	TransformKey* a = &(*keys)[next == 0 ? 0 : next - 1];
+	TransformKey* b = &(*keys)[next == keys->size() ? next - 1 : next];
+	float t = a->frame == b->frame ? 0 : (float)(frame - a->frame) / (b->frame - a->frame);
+
+	Vector3 translation = Vector3Lerp(a->translation, b->translation, t);
+	Vector3 rotation = Vector3Scale(Vector3Lerp(a->rotation, b->rotation, t), DEG2RAD);
+
+	return MatrixRotateXYZ(rotation) * MatrixTranslate(translation.x, translation.y, translation.z);
+}
+
+SceneGeometry SceneDescription::BuildGeometry(int frame)
+{
+	SceneGeometry geometry;
+
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		Model model = objects[i].model;
+		model.transform = InterpolateTransform(&objects[i].transformKeys, frame);
+
+		if (!objects[i].modelMaterials.empty())
+		{
+			TracingEngine::AppendRaylibModel(&geometry, model, objects[i].modelMaterials, objects[i].indexed, objects[i].bvhDepth);
+		}
+		else
+		{
+			TracingEngine::AppendRaylibModel(&geometry, model, objects[i].materialIndex, objects[i].indexed, objects[i].bvhDepth);
+		}
+	}
+
+	TracingEngine::GenerateBVHS(&geometry);
+
+	return geometry;
+}
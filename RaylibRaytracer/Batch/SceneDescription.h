@@ -0,0 +1,124 @@
+#pragma once
+
+#include "../Graphics/TracingEngine.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <raylib.h>
+
+struct RenderSettings
+{
+	int width = 1024;
+	int height = 512;
+	int samples = 100;
+	int raysPerPixel = 10;
+	int maxBounces = 7;
+	float blur = 0.001f;
+	int frames = 1;
+	int seed = 0;
+	float timeBudget = 0;
+};
+
+// Command line options shared by the unattended modes, -1 keeps the value from the scene file
+struct RenderOptions
+{
+	std::string scenePath;
+	std::string outputPath;
+
+	int width = -1;
+	int height = -1;
+	int samples = -1;
+	int seed = -1;
+
+	// '<mode> <scene> [--option value]...', options other than the shared ones go to parseOption which returns false for unknown ones
+	bool ParseArguments(int argc, char** argv, const std::function<bool(const std::string& option, const char* value)>& parseOption);
+	void Apply(RenderSettings* settings);
+};
+
+struct TransformKey
+{
+	int frame;
+	Vector3 translation;
+	Vector3 rotation;
+};
+
+struct CameraKey
+{
+	int frame;
+	Vector3 position;
+	Vector3 target;
+	float fovy;
+};
+
+struct SceneMaterial
+{
+	std::string name;
+	std::string texture;
+	RaytracingMaterial material;
+};
+
+enum SceneObjectType
+{
+	SCENE_OBJECT_MODEL,
+	SCENE_OBJECT_PLANE,
+	SCENE_OBJECT_CUBE
+};
+
+struct SceneObject
+{
+	SceneObjectType type;
+	std::string path;
+	Vector3 size;
+	std::string material;
+	bool indexed;
+	int bvhDepth;
+	std::vector<TransformKey> transformKeys;
+
+	Model model;
+	int materialIndex;
+	std::vector<int> modelMaterials;    // material '*', indices of the model's own materials
+};
+
+// Text scene format for unattended renders, one statement per line, '#' starts a comment:
+//
+//   resolution <width> <height>
+//   samples <spp>
+//   rays <rays per pixel per pass>
+//   bounces <max bounces>
+//   blur <amount>
+//   frames <count>
+//   seed <int>
+//   time <seconds per frame, 0 renders the full sample count>
+//   sky <zenith rgb> <horizon rgb> <ground rgb> <sun rgb> <sun direction xyz> <focus> <intensity>
+//   material <name> <color rgba> <emission rgb strength> <e_s_b_b xyzw> [texture path, multiplies the colour]
+//   model <path> <material or *> <indexed 0|1> <bvh depth>     * keeps the model file's own materials and textures
+//   plane <width> <length> <material> <bvh depth>
+//   cube <width> <height> <length> <material> <bvh depth>
+//   transform <frame> <translation xyz> <rotation xyz in degrees>     applies to the previous object
+//   camera <frame> <position xyz> <target xyz> <fovy>
+//
+// BVH depths go from 0 to MAX_BVH_DEPTH. Sky colours are 0-255, transforms and cameras are interpolated linearly between keyframes.
+class SceneDescription
+{
+private:
+	static Matrix InterpolateTransform(std::vector<TransformKey>* keys, int frame);
+
+public:
+	RenderSettings settings;
+	SkyMaterial sky = { WHITE, SKYBLUE, BROWN, WHITE, Vector3(-0.5f, -1, -0.5f), 1, 0.5f };
+
+	std::vector<SceneMaterial> materials;
+	std::vector<SceneObject> objects;
+	std::vector<CameraKey> cameraKeys;
+
+	bool Parse(const char* path);
+
+	// needs a GL context and an initialized TracingEngine
+	bool Load();
+	void Unload();
+
+	bool IsAnimated();
+	Camera GetCamera(int frame);
+	SceneGeometry BuildGeometry(int frame);
+};
@@ -0,0 +1,478 @@
+#include "Coordinator.h"
+#include "../Batch/ImageWriter.h"
+
+#include <raylib.h>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <list>
+
+#if defined(_WIN32)
+	#include <process.h>
+#else
+	#include <spawn.h>
+	extern char** environ;
+#endif
+
+bool Coordinator::IsCoordinatorCommand(int argc, char** argv)
+{
+	return argc > 1 && strcmp(argv[1], "--coordinator") == 0;
+}
+
+void Coordinator::PrintUsage()
+{
+	std::cout << "usage: RaylibRaytracer --coordinator <scene> [options]\n"
+		"  --workers <count>   start this many workers on this machine, remote ones connect with --worker <host> [port]\n"
+		"  --port <port>       port to accept workers on (" << DISTRIBUTED_DEFAULT_PORT << ")\n"
+		"  --output <path>     .exr or .png (render.png)\n"
+		"  --frame <index>     frame of the scene animation to render\n"
+		"  --tile <pixels>     tile edge length (128)\n"
+		"  --chunk <passes>    passes per work item, a pass traces the scene's rays per pixel (4)\n"
+		"  --timeout <seconds> drop workers silent this long, give up once there were none for this long (60)\n"
+		"  --width <pixels>    override the scene resolution\n"
+		"  --height <pixels>\n"
+		"  --samples <spp>\n"
+		"  --seed <int>\n";
+}
+
+bool Coordinator::ParseArguments(int argc, char** argv, CoordinatorOptions* options)
+{
+	bool parsed = options->render.ParseArguments(argc, argv, [options](const std::string& option, const char* value)
+	{
+		if (option == "--workers") options->localWorkers = atoi(value);
+		else if (option == "--port") options->port = atoi(value);
+		else if (option == "--frame") options->frame = atoi(value);
+		else if (option == "--tile") options->tileSize = atoi(value);
+		else if (option == "--chunk") options->passesPerItem = atoi(value);
+		else if (option == "--timeout") options->timeout = atoi(value);
+		else return false;
+
+		return true;
+	});
+
+	// a tile's result has to fit in one message
+	return parsed && options->tileSize > 0 && options->passesPerItem > 0 && options->timeout > 0
+		&& (size_t)options->tileSize * options->tileSize * 3 * sizeof(float) < MAX_MESSAGE_SIZE - sizeof(TileResult);
+}
+
+bool Coordinator::SpawnLocalWorker(const char* executable, int port)
+{
+	const char* portText = TextFormat("%i", port);
+
+#if defined(_WIN32)
+	return _spawnl(_P_NOWAIT, executable, executable, "--worker", "127.0.0.1", portText, nullptr) != -1;
+#else
+	char* arguments[] = { (char*)executable, (char*)"--worker", (char*)"127.0.0.1", (char*)portText, nullptr };
+	pid_t pid;
+	return posix_spawnp(&pid, executable, nullptr, nullptr, arguments, environ) == 0;
+#endif
+}
+
+std::vector<WorkState> Coordinator::CreateWorkItems(RenderSettings* settings, int tileSize, int passesPerItem, FrameAccumulation* frame)
+{
+	std::vector<WorkState> work;
+
+	int passes = (settings->samples + settings->raysPerPixel - 1) / settings->raysPerPixel;
+
+	*frame = { settings->width, settings->height };
+	frame->radiance.resize(settings->width * settings->height * 3, 0.0);
+	frame->samples.resize(settings->width * settings->height, 0.0);
+
+	// last item created for each tile, to chain its chunks in pass order
+	std::vector<int> tileLast;
+
+	// all tiles get their first samples before any tile gets more, so a cancelled run is still a whole picture
+	for (int firstPass = 0; firstPass < passes; firstPass += passesPerItem)
+	{
+		int tile = 0;
+
+		for (int y = 0; y < settings->height; y += tileSize)
+		{
+			for (int x = 0; x < settings->width; x += tileSize)
+			{
+				WorkState state;
+				state.item = { (int)work.size(), x, y, std::min(tileSize, settings->width - x), std::min(tileSize, settings->height - y), firstPass, std::min(passesPerItem, passes - firstPass) };
+				state.tile = tile;
+
+				if (firstPass == 0)
+				{
+					frame->tileNext.push_back(state.item.id);
+					tileLast.push_back(state.item.id);
+				}
+				else
+				{
+					work[tileLast[tile]].nextChunk = state.item.id;
+					tileLast[tile] = state.item.id;
+				}
+
+				work.push_back(state);
+				tile++;
+			}
+		}
+	}
+
+	return work;
+}
+
+int Coordinator::NextWorkItem(std::vector<WorkState>* work)
+{
+	int best = -1;
+
+	for (size_t i = 0; i < work->size(); i++)
+	{
+		WorkState* state = &(*work)[i];
+
+		if (state->done)
+		{
+			continue;
+		}
+
+		if (state->assigned == 0)
+		{
+			return i;
+		}
+
+		// nothing fresh left, duplicate whatever has the fewest workers on it
+		if (best == -1 || state->assigned < (*work)[best].assigned)
+		{
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+void Coordinator::MergeResult(WorkState* state, FrameAccumulation* frame)
+{
+	WorkItem* item = &state->item;
+	TileResult* result = &state->result;
+
+	for (int y = 0; y < item->height; y++)
+	{
+		for (int x = 0; x < item->width; x++)
+		{
+			int source = y * item->width + x;
+			int target = (item->y + y) * frame->width + item->x + x;
+
+			frame->radiance[target * 3 + 0] += (double)result->radiance[source * 3 + 0] * result->samples;
+			frame->radiance[target * 3 + 1] += (double)result->radiance[source * 3 + 1] * result->samples;
+			frame->radiance[target * 3 + 2] += (double)result->radiance[source * 3 + 2] * result->samples;
+			frame->samples[target] += result->samples;
+		}
+	}
+
+	std::vector<float>().swap(result->radiance);
+}
+
+void Coordinator::MergeFinishedChunks(std::vector<WorkState>* work, int tile, FrameAccumulation* frame)
+{
+	// tiles never overlap, so a fixed chunk order per tile keeps the sum, and so the image, independent of which worker finished first
+	int next = frame->tileNext[tile];
+
+	while (next != -1 && (*work)[next].done)
+	{
+		MergeResult(&(*work)[next], frame);
+		next = (*work)[next].nextChunk;
+	}
+
+	frame->tileNext[tile] = next;
+}
+
+std::vector<float> Coordinator::ResolveAccumulation(FrameAccumulation* frame)
+{
+	std::vector<float> pixels(frame->width * frame->height * 4);
+
+	for (int i = 0; i < frame->width * frame->height; i++)
+	{
+		double weight = frame->samples[i] > 0 ? 1.0 / frame->samples[i] : 0.0;
+		pixels[i * 4 + 0] = (float)(frame->radiance[i * 3 + 0] * weight);
+		pixels[i * 4 + 1] = (float)(frame->radiance[i * 3 + 1] * weight);
+		pixels[i * 4 + 2] = (float)(frame->radiance[i * 3 + 2] * weight);
+		pixels[i * 4 + 3] = 1;
+	}
+
+	return pixels;
+}
+
+void Coordinator::ServeWorker(WorkerConnection* worker, const std::vector<unsigned char>* scenePayload, int raysPerPixel)
+{
+	// the scene is by far the largest message, the other connections keep going while it is sent
+	bool ok = Protocol::Send(&worker->socket, MESSAGE_SCENE, *scenePayload);
+	bool finished = false;
+
+	if (ok)
+	{
+		TraceLog(LOG_INFO, "COORDINATOR: Worker %i connected", worker->id);
+	}
+
+	while (ok && !finished)
+	{
+		MessageType type;
+		std::vector<unsigned char> payload;
+		ok = Protocol::Receive(&worker->socket, &type, &payload);
+
+		// workers hold at most one item, asking for another before returning it is a protocol error
+		if (ok && type == MESSAGE_REQUEST && worker->currentItem == -1)
+		{
+			WorkItem item;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				int next = NextWorkItem(&work);
+				finished = next == -1;
+
+				if (!finished)
+				{
+					work[next].assigned++;
+					worker->currentItem = next;
+					item = work[next].item;
+				}
+			}
+
+			ok = finished ? Protocol::Send(&worker->socket, MESSAGE_DONE, {}) : Protocol::Send(&worker->socket, MESSAGE_WORK, Protocol::SerializeWork(item));
+		}
+		else if (ok && type == MESSAGE_RESULT && worker->currentItem != -1)
+		{
+			// items never change once created, only their state does
+			WorkItem* item = &work[worker->currentItem].item;
+			TileResult result;
+
+			ok = Protocol::DeserializeResult(payload, &result) && result.id == worker->currentItem
+				&& result.radiance.size() == (size_t)item->width * item->height * 3
+				&& result.samples == item->passCount * raysPerPixel;
+
+			if (ok)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				WorkState* state = &work[result.id];
+
+				state->assigned--;
+				worker->currentItem = -1;
+
+				// duplicates trace identical seeds, keep the first copy and drop the rest
+				if (state->done)
+				{
+					worker->duplicates++;
+				}
+				else
+				{
+					state->done = true;
+					state->result = std::move(result);
+					MergeFinishedChunks(&work, state->tile, &frame);
+					remaining--;
+					worker->completed++;
+					worker->samples += (long long)state->item.width * state->item.height * state->result.samples;
+				}
+			}
+		}
+		else
+		{
+			ok = false;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// whatever it was working on goes back to the pool
+	if (worker->currentItem != -1)
+	{
+		work[worker->currentItem].assigned--;
+		worker->currentItem = -1;
+	}
+
+	if (!finished && remaining > 0)
+	{
+		TraceLog(LOG_WARNING, "COORDINATOR: Worker %i disconnected", worker->id);
+	}
+
+	activeWorkers--;
+}
+
+int Coordinator::Run(int argc, char** argv)
+{
+	CoordinatorOptions options;
+
+	if (!ParseArguments(argc, argv, &options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	SceneDescription description;
+
+	if (!description.Parse(options.render.scenePath.c_str()))
+	{
+		return 1;
+	}
+
+	RenderSettings* settings = &description.settings;
+	options.render.Apply(settings);
+
+	// only needed to load meshes, the coordinator itself never traces
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(16, 16, "raylib raytracer coordinator");
+
+	if (!description.Load())
+	{
+		description.Unload();
+		CloseWindow();
+		return 1;
+	}
+
+	SceneMessage scene;
+	scene.settings = *settings;
+	scene.frame = options.frame;
+	scene.camera = description.GetCamera(options.frame);
+	scene.sky = description.sky;
+	scene.geometry = description.BuildGeometry(options.frame);
+
+	if (!TracingEngine::FitsBuffers(&scene.geometry))
+	{
+		description.Unload();
+		CloseWindow();
+		return 1;
+	}
+
+	// Load registered scene and model materials with the engine, ship its table so indices stay the same
+	for (int i = 0; i < TracingEngine::GetMaterialCount(); i++)
+	{
+		scene.materials.push_back(TracingEngine::GetMaterial(i));
+	}
+
+	for (const Image& image : TracingEngine::GetTextures())
+	{
+		unsigned char* pixels = (unsigned char*)image.data;
+		scene.textures.push_back({ image.width, image.height, std::vector<unsigned char>(pixels, pixels + image.width * image.height * 4) });
+	}
+
+	std::vector<unsigned char> scenePayload = Protocol::SerializeScene(scene);
+
+	Socket::Startup();
+
+	Socket listener = Socket::Listen(options.port);
+
+	if (!listener.IsValid())
+	{
+		TraceLog(LOG_ERROR, "COORDINATOR: Failed to listen on port %i", options.port);
+		Socket::Shutdown();
+		description.Unload();
+		CloseWindow();
+		return 1;
+	}
+
+	for (int i = 0; i < options.localWorkers; i++)
+	{
+		if (!SpawnLocalWorker(argv[0], options.port))
+		{
+			TraceLog(LOG_WARNING, "COORDINATOR: Failed to start local worker %i", i);
+		}
+	}
+
+	work = CreateWorkItems(settings, options.tileSize, options.passesPerItem, &frame);
+	remaining = work.size();
+
+	// a list, connection threads keep a pointer to their entry
+	std::list<WorkerConnection> workers;
+	int connected = 0;
+
+	TraceLog(LOG_INFO, "COORDINATOR: %i work items, waiting for workers on port %i", (int)work.size(), options.port);
+
+	double start = GetTime();
+	double idleSince = start;
+	bool abandoned = false;
+
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (remaining == 0)
+			{
+				break;
+			}
+
+			if (activeWorkers > 0)
+			{
+				idleSince = GetTime();
+			}
+		}
+
+		if (GetTime() - idleSince > options.timeout)
+		{
+			TraceLog(LOG_ERROR, "COORDINATOR: No workers for %i s, giving up with %i work items left", options.timeout, remaining);
+			abandoned = true;
+			break;
+		}
+
+		// wake up regularly to notice the frame finishing or the last worker leaving
+		if (Socket::WaitReadable({ &listener }, 500).empty())
+		{
+			continue;
+		}
+
+		Socket socket = listener.Accept();
+
+		if (!socket.IsValid())
+		{
+			continue;
+		}
+
+		// a worker silent for this long is dropped and its item goes back to the pool
+		socket.SetTimeout(options.timeout);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeWorkers++;
+		}
+
+		WorkerConnection* worker = &workers.emplace_back();
+		worker->id = connected++;
+		worker->socket = socket;
+		worker->thread = std::thread(ServeWorker, worker, &scenePayload, settings->raysPerPixel);
+	}
+
+	double runTime = GetTime() - start;
+
+	// workers still tracing a duplicate or stuck mid message are cut off, nothing they send is needed anymore
+	for (WorkerConnection& worker : workers)
+	{
+		worker.socket.Abort();
+		worker.thread.join();
+		worker.socket.Close();
+
+		TraceLog(LOG_INFO, "COORDINATOR: Worker %i, %i items, %i duplicates, %.1f Mpaths/s", worker.id, worker.completed, worker.duplicates, worker.samples / runTime / 1000000.0);
+	}
+
+	listener.Close();
+	Socket::Shutdown();
+
+	if (abandoned)
+	{
+		description.Unload();
+		CloseWindow();
+		return 1;
+	}
+
+	std::vector<float> pixels = ResolveAccumulation(&frame);
+
+	double totalPaths = 0;
+	for (size_t i = 0; i < work.size(); i++)
+	{
+		totalPaths += (double)work[i].item.width * work[i].item.height * work[i].result.samples;
+	}
+
+	TraceLog(LOG_INFO, "COORDINATOR: Frame %i in %.2f s (%.1f Mpaths/s)", options.frame, runTime, totalPaths / runTime / 1000000.0);
+
+	bool written = ImageWriter::Write(options.render.outputPath.c_str(), settings->width, settings->height, pixels);
+
+	if (!written)
+	{
+		TraceLog(LOG_ERROR, "COORDINATOR: [%s] Failed to write image", options.render.outputPath.c_str());
+	}
+
+	description.Unload();
+	CloseWindow();
+
+	return written ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Protocol.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+struct CoordinatorOptions
+{
+	RenderOptions render = { .outputPath = "render.png" };
+
+	int port = DISTRIBUTED_DEFAULT_PORT;
+	int localWorkers = 0;
+	int frame = 0;
+	int tileSize = 128;
+	int passesPerItem = 4;
+	int timeout = 60;
+};
+
+struct WorkState
+{
+	WorkItem item;
+	int tile;
+	int nextChunk = -1;    // item with the following passes of the same tile
+	int assigned = 0;
+	bool done = false;
+	TileResult result;     // radiance is freed once merged
+};
+
+// Results are summed per tile in pass order as soon as every earlier chunk of the tile arrived, the sums then
+// do not depend on which worker finished first and each result can be freed right after
+struct FrameAccumulation
+{
+	int width;
+	int height;
+	std::vector<double> radiance;
+	std::vector<double> samples;
+	std::vector<int> tileNext;    // first item of each tile not merged yet, -1 once all are
+};
+
+struct WorkerConnection
+{
+	int id;
+	Socket socket;
+	std::thread thread;
+	int currentItem = -1;
+	int completed = 0;
+	int duplicates = 0;
+	long long samples = 0;
+};
+
+// Splits one frame into tiles and sample ranges and hands them to worker processes on request. Workers that run
+// out of fresh work get a copy of the least covered unfinished item, so one slow machine cannot hold up the frame.
+// Every connection is served on its own thread, so sending a scene or a stalled peer only ever holds up that one.
+class Coordinator
+{
+private:
+	// shared by the connection threads, guarded by mutex
+	inline static std::mutex mutex;
+	inline static std::vector<WorkState> work;
+	inline static FrameAccumulation frame;
+	inline static int remaining = 0;
+	inline static int activeWorkers = 0;
+
+	static bool ParseArguments(int argc, char** argv, CoordinatorOptions* options);
+	static void PrintUsage();
+	static bool SpawnLocalWorker(const char* executable, int port);
+	static std::vector<WorkState> CreateWorkItems(RenderSettings* settings, int tileSize, int passesPerItem, FrameAccumulation* frame);
+	static int NextWorkItem(std::vector<WorkState>* work);
+	static void MergeResult(WorkState* state, FrameAccumulation* frame);
+	static void MergeFinishedChunks(std::vector<WorkState>* work, int tile, FrameAccumulation* frame);
+	static std::vector<float> ResolveAccumulation(FrameAccumulation* frame);
+	static void ServeWorker(WorkerConnection* worker, const std::vector<unsigned char>* scenePayload, int raysPerPixel);
+
+public:
+	static bool IsCoordinatorCommand(int argc, char** argv);
+	static int Run(int argc, char** argv);
+};
@@ -0,0 +1,126 @@
+#include "Protocol.h"
+
+bool Protocol::Send(Socket* socket, MessageType type, const std::vector<unsigned char>& payload)
+{
+	MessageHeader header = { type, 0, payload.size() };
+
+	return socket->Send(&header, sizeof(header)) && (payload.empty() || socket->Send(payload.data(), payload.size()));
+}
+
+bool Protocol::Receive(Socket* socket, MessageType* type, std::vector<unsigned char>* payload)
+{
+	MessageHeader header;
+
+	if (!socket->Receive(&header, sizeof(header)) || header.size > MAX_MESSAGE_SIZE)
+	{
+		return false;
+	}
+
+	*type = (MessageType)header.type;
+	payload->resize(header.size);
+
+	return header.size == 0 || socket->Receive(payload->data(), header.size);
+}
+
+void Protocol::WriteTextures(MessageWriter* writer, const std::vector<TexturePixels>& textures)
+{
+	writer->Write((uint64_t)textures.size());
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		writer->Write(textures[i].width);
+		writer->Write(textures[i].height);
+		writer->WriteVector(textures[i].rgba);
+	}
+}
+
+bool Protocol::ReadTextures(MessageReader* reader, std::vector<TexturePixels>* textures)
+{
+	uint64_t count = 0;
+
+	if (!reader->Read(&count) || count > MAX_TEXTURE_LAYERS)
+	{
+		return false;
+	}
+
+	textures->resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		TexturePixels* texture = &(*textures)[i];
+
+		if (!reader->Read(&texture->width) || !reader->Read(&texture->height) || !reader->ReadVector(&texture->rgba))
+		{
+			return false;
+		}
+
+		if (texture->width <= 0 || texture->height <= 0 || texture->width > MAX_TEXTURE_SIZE || texture->height > MAX_TEXTURE_SIZE
+			|| texture->rgba.size() != (size_t)texture->width * texture->height * 4)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::vector<unsigned char> Protocol::SerializeScene(const SceneMessage& scene)
+{
+	MessageWriter writer;
+	writer.Write(scene.settings);
+	writer.Write(scene.frame);
+	writer.Write(scene.camera);
+	writer.Write(scene.sky);
+	writer.WriteVector(scene.materials);
+	WriteTextures(&writer, scene.textures);
+	writer.WriteVector(scene.geometry.triangles);
+	writer.WriteVector(scene.geometry.uvs);
+	writer.WriteVector(scene.geometry.meshes);
+	writer.WriteVector(scene.geometry.nodes);
+	return writer.data;
+}
+
+bool Protocol::DeserializeScene(const std::vector<unsigned char>& payload, SceneMessage* scene)
+{
+	MessageReader reader(&payload);
+	return reader.Read(&scene->settings)
+		&& reader.Read(&scene->frame)
+		&& reader.Read(&scene->camera)
+		&& reader.Read(&scene->sky)
+		&& reader.ReadVector(&scene->materials)
+		&& ReadTextures(&reader, &scene->textures)
+		&& reader.ReadVector(&scene->geometry.triangles)
+		&& reader.ReadVector(&scene->geometry.uvs)
+		&& reader.ReadVector(&scene->geometry.meshes)
+		&& reader.ReadVector(&scene->geometry.nodes);
+}
+
+std::vector<unsigned char> Protocol::SerializeWork(const WorkItem& item)
+{
+	MessageWriter writer;
+	writer.Write(item);
+	return writer.data;
+}
+
+bool Protocol::DeserializeWork(const std::vector<unsigned char>& payload, WorkItem* item)
+{
+	MessageReader reader(&payload);
+	return reader.Read(item);
+}
+
+std::vector<unsigned char> Protocol::SerializeResult(const TileResult& result)
+{
+	MessageWriter writer;
+	writer.Write(result.id);
+	writer.Write(result.samples);
+	writer.WriteVector(result.radiance);
+	return writer.data;
+}
+
+bool Protocol::DeserializeResult(const std::vector<unsigned char>& payload, TileResult* result)
+{
+	MessageReader reader(&payload);
+	return reader.Read(&result->id)
+		&& reader.Read(&result->samples)
+		&& reader.ReadVector(&result->radiance);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Socket.h"
+#include "../Batch/SceneDescription.h"
+#include "../Graphics/TracingEngine.h"
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <raylib.h>
+
+#define DISTRIBUTED_DEFAULT_PORT 47600
+
+// Messages are a MessageHeader followed by size bytes of payload. Structs travel as raw bytes, so coordinator
+// and workers must share a build and byte order.
+enum MessageType : uint32_t
+{
+	MESSAGE_SCENE = 1,  // coordinator -> worker, sent once after connecting
+	MESSAGE_REQUEST,    // worker -> coordinator, ready for the next work item
+	MESSAGE_WORK,       // coordinator -> worker, one WorkItem
+	MESSAGE_RESULT,     // worker -> coordinator, one TileResult
+	MESSAGE_DONE        // coordinator -> worker, no work left, exit
+};
+
+struct MessageHeader
+{
+	uint32_t type;
+	uint32_t padding;
+	uint64_t size;
+};
+
+struct WorkItem
+{
+	int id;
+	int x;
+	int y;
+	int width;
+	int height;
+	int firstPass;
+	int passCount;
+};
+
+struct TileResult
+{
+	int id;
+	int samples;
+	std::vector<float> radiance;    // rgb, averaged over samples, rows top down
+};
+
+struct TexturePixels
+{
+	int width;
+	int height;
+	std::vector<unsigned char> rgba;
+};
+
+struct SceneMessage
+{
+	RenderSettings settings;
+	int frame;
+	Camera camera;
+	SkyMaterial sky;
+	std::vector<RaytracingMaterial> materials;
+	std::vector<TexturePixels> textures;    // in AddTexture order
+	SceneGeometry geometry;
+};
+
+// nothing legitimate is bigger than a scene filling every tracing buffer, larger sizes from a confused peer are refused before allocating
+#define MAX_MESSAGE_SIZE (sizeof(SceneMessage) + sizeof(MaterialBuffer) + sizeof(TriangleBuffer) + sizeof(TriangleUVBuffer) + sizeof(MeshBuffer) + sizeof(NodeBuffer) \
+	+ MAX_TEXTURE_LAYERS * (sizeof(TexturePixels) + (size_t)MAX_TEXTURE_SIZE * MAX_TEXTURE_SIZE * 4))
+
+class MessageWriter
+{
+public:
+	std::vector<unsigned char> data;
+
+	template<typename T>
+	void Write(const T& value)
+	{
+		const unsigned char* bytes = (const unsigned char*)&value;
+		data.insert(data.end(), bytes, bytes + sizeof(T));
+	}
+
+	template<typename T>
+	void WriteVector(const std::vector<T>& values)
+	{
+		Write((uint64_t)values.size());
+		const unsigned char* bytes = (const unsigned char*)values.data();
+		data.insert(data.end(), bytes, bytes + values.size() * sizeof(T));
+	}
+};
+
+class MessageReader
+{
+private:
+	const std::vector<unsigned char>* data;
+	size_t offset = 0;
+
+public:
+	MessageReader(const std::vector<unsigned char>* data) : data(data) {}
+
+	template<typename T>
+	bool Read(T* value)
+	{
+		if (data->size() - offset < sizeof(T))
+		{
+			return false;
+		}
+
+		memcpy(value, data->data() + offset, sizeof(T));
+		offset += sizeof(T);
+		return true;
+	}
+
+	template<typename T>
+	bool ReadVector(std::vector<T>* values)
+	{
+		uint64_t count = 0;
+
+		if (!Read(&count) || count > (data->size() - offset) / sizeof(T))
+		{
+			return false;
+		}
+
+		values->resize(count);
+		memcpy(values->data(), data->data() + offset, count * sizeof(T));
+		offset += count * sizeof(T);
+		return true;
+	}
+};
+
+class Protocol
+{
+private:
+	static void WriteTextures(MessageWriter* writer, const std::vector<TexturePixels>& textures);
+	static bool ReadTextures(MessageReader* reader, std::vector<TexturePixels>* textures);
+
+public:
+	static bool Send(Socket* socket, MessageType type, const std::vector<unsigned char>& payload);
+	static bool Receive(Socket* socket, MessageType* type, std::vector<unsigned char>* payload);
+
+	static std::vector<unsigned char> SerializeScene(const SceneMessage& scene);
+	static bool DeserializeScene(const std::vector<unsigned char>& payload, SceneMessage* scene);
+
+	static std::vector<unsigned char> SerializeWork(const WorkItem& item);
+	static bool DeserializeWork(const std::vector<unsigned char>& payload, WorkItem* item);
+
+	static std::vector<unsigned char> SerializeResult(const TileResult& result);
+	static bool DeserializeResult(const std::vector<unsigned char>& payload, TileResult* result);
+};
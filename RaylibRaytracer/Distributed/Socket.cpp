@@ -0,0 +1,251 @@
+#include "Socket.h"
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOGDI
+	#define NOUSER
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	typedef SOCKET NativeSocket;
+	#define CloseNativeSocket closesocket
+	#define SHUTDOWN_BOTH SD_BOTH
+#else
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <netdb.h>
+	#include <unistd.h>
+	#include <sys/time.h>
+	typedef int NativeSocket;
+	#define INVALID_SOCKET -1
+	#define CloseNativeSocket close
+	#define SHUTDOWN_BOTH SHUT_RDWR
+#endif
+
+// a worker dropping out must not take the coordinator down with SIGPIPE
+#if defined(MSG_NOSIGNAL)
+	#define SEND_FLAGS MSG_NOSIGNAL
+#else
+	#define SEND_FLAGS 0
+#endif
+
+#include <cstdio>
+#include <cstring>
+
+bool Socket::Startup()
+{
+#if defined(_WIN32)
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+	return true;
+#endif
+}
+
+void Socket::Shutdown()
+{
+#if defined(_WIN32)
+	WSACleanup();
+#endif
+}
+
+Socket Socket::Listen(int port)
+{
+	Socket result;
+
+	NativeSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (s == INVALID_SOCKET)
+	{
+		return result;
+	}
+
+	int reuse = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if (bind(s, (sockaddr*)&address, sizeof(address)) != 0 || listen(s, 64) != 0)
+	{
+		CloseNativeSocket(s);
+		return result;
+	}
+
+	result.handle = (long long)s;
+	return result;
+}
+
+Socket Socket::Connect(const char* host, int port)
+{
+	Socket result;
+
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	char service[16];
+	snprintf(service, sizeof(service), "%i", port);
+
+	addrinfo* addresses = nullptr;
+
+	if (getaddrinfo(host, service, &hints, &addresses) != 0)
+	{
+		return result;
+	}
+
+	for (addrinfo* a = addresses; a != nullptr; a = a->ai_next)
+	{
+		NativeSocket s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+
+		if (s == INVALID_SOCKET)
+		{
+			continue;
+		}
+
+		if (connect(s, a->ai_addr, (int)a->ai_addrlen) == 0)
+		{
+			// work requests are tiny and latency bound
+			int noDelay = 1;
+			setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+			result.handle = (long long)s;
+			break;
+		}
+
+		CloseNativeSocket(s);
+	}
+
+	freeaddrinfo(addresses);
+	return result;
+}
+
+std::vector<int> Socket::WaitReadable(const std::vector<Socket*>& sockets, int timeoutMs)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+
+	NativeSocket highest = 0;
+
+	for (size_t i = 0; i < sockets.size(); i++)
+	{
+		NativeSocket s = (NativeSocket)sockets[i]->handle;
+		FD_SET(s, &readable);
+		highest = s > highest ? s : highest;
+	}
+
+	std::vector<int> result;
+
+	timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+
+	if (select((int)highest + 1, &readable, nullptr, nullptr, timeoutMs < 0 ? nullptr : &timeout) <= 0)
+	{
+		return result;
+	}
+
+	for (size_t i = 0; i < sockets.size(); i++)
+	{
+		if (FD_ISSET((NativeSocket)sockets[i]->handle, &readable))
+		{
+			result.push_back(i);
+		}
+	}
+
+	return result;
+}
+
+Socket Socket::Accept()
+{
+	Socket result;
+
+	NativeSocket s = accept((NativeSocket)handle, nullptr, nullptr);
+
+	if (s != INVALID_SOCKET)
+	{
+		int noDelay = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+		result.handle = (long long)s;
+	}
+
+	return result;
+}
+
+void Socket::SetTimeout(int seconds)
+{
+#if defined(_WIN32)
+	DWORD timeout = seconds * 1000;
+#else
+	timeval timeout = { seconds, 0 };
+#endif
+
+	setsockopt((NativeSocket)handle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	setsockopt((NativeSocket)handle, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+void Socket::Abort()
+{
+	if (IsValid())
+	{
+		shutdown((NativeSocket)handle, SHUTDOWN_BOTH);
+	}
+}
+
+bool Socket::Send(const void* data, size_t size)
+{
+	const char* bytes = (const char*)data;
+
+	while (size > 0)
+	{
+		int sent = send((NativeSocket)handle, bytes, (int)(size > 1 << 30 ? 1 << 30 : size), SEND_FLAGS);
+
+		if (sent <= 0)
+		{
+			return false;
+		}
+
+		bytes += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+bool Socket::Receive(void* data, size_t size)
+{
+	char* bytes = (char*)data;
+
+	while (size > 0)
+	{
+		int received = recv((NativeSocket)handle, bytes, (int)(size > 1 << 30 ? 1 << 30 : size), 0);
+
+		if (received <= 0)
+		{
+			return false;
+		}
+
+		bytes += received;
+		size -= received;
+	}
+
+	return true;
+}
+
+bool Socket::IsValid()
+{
+	return handle != -1 && handle != (long long)INVALID_SOCKET;
+}
+
+void Socket::Close()
+{
+	if (IsValid())
+	{
+		CloseNativeSocket((NativeSocket)handle);
+	}
+
+	handle = -1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// Minimal blocking TCP socket over winsock or BSD sockets
+class Socket
+{
+private:
+	long long handle = -1;
+
+public:
+	static bool Startup();
+	static void Shutdown();
+
+	static Socket Listen(int port);
+	static Socket Connect(const char* host, int port);
+
+	// blocks until at least one socket can be read or timeoutMs passed, -1 waits forever. Returns their indices
+	static std::vector<int> WaitReadable(const std::vector<Socket*>& sockets, int timeoutMs);
+
+	Socket Accept();
+
+	// sends and receives that make no progress for this long fail
+	void SetTimeout(int seconds);
+	// makes blocked and future sends and receives fail, from any thread. Close still has to be called
+	void Abort();
+
+	bool Send(const void* data, size_t size);
+	bool Receive(void* data, size_t size);
+
+	bool IsValid();
+	void Close();
+};
@@ -0,0 +1,245 @@
+#include "Worker.h"
+#include "../Graphics/TracingEngine.h"
+#include "../Graphics/Profiler.h"
+
+#include <raylib.h>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+bool Worker::IsWorkerCommand(int argc, char** argv)
+{
+	return argc > 1 && strcmp(argv[1], "--worker") == 0;
+}
+
+bool Worker::HasValidIndices(SceneMessage* scene)
+{
+	SceneGeometry* geometry = &scene->geometry;
+	int numTriangles = geometry->triangles.size();
+	int numNodes = geometry->nodes.size();
+
+	for (size_t i = 0; i < scene->materials.size(); i++)
+	{
+		if (scene->materials[i].textureIndex < 0 || scene->materials[i].textureIndex > (int)scene->textures.size())
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < geometry->meshes.size(); i++)
+	{
+		RaytracingMesh* mesh = &geometry->meshes[i];
+
+		if (mesh->firstTriangleIndex < 0 || mesh->numTriangles < 0 || mesh->firstTriangleIndex > numTriangles - mesh->numTriangles
+			|| mesh->rootNodeIndex < 0 || mesh->rootNodeIndex >= numNodes
+			|| mesh->materialIndex < 0 || mesh->materialIndex >= (int)scene->materials.size())
+		{
+			return false;
+		}
+	}
+
+	// SplitNode always appends children after their parent, so forward links rule out cycles and depths can be
+	// found in one pass. The shader's traversal stack only has room for trees up to MAX_BVH_DEPTH
+	std::vector<int> depths(numNodes, 0);
+
+	for (int i = 0; i < numNodes; i++)
+	{
+		Node* node = &geometry->nodes[i];
+
+		if (node->triangleIndex < 0 || node->numTriangles < 0 || node->triangleIndex > numTriangles - node->numTriangles)
+		{
+			return false;
+		}
+
+		if (node->childIndex == 0)
+		{
+			continue;
+		}
+
+		if (node->childIndex <= i || node->childIndex >= numNodes - 1 || depths[i] == MAX_BVH_DEPTH)
+		{
+			return false;
+		}
+
+		depths[node->childIndex] = std::max(depths[node->childIndex], depths[i] + 1);
+		depths[node->childIndex + 1] = std::max(depths[node->childIndex + 1], depths[i] + 1);
+	}
+
+	return true;
+}
+
+bool Worker::LoadScene(SceneMessage* scene)
+{
+	RenderSettings* settings = &scene->settings;
+
+	if (settings->width <= 0 || settings->height <= 0 || settings->raysPerPixel <= 0 || settings->maxBounces < 0)
+	{
+		TraceLog(LOG_ERROR, "WORKER: Invalid render settings from the coordinator");
+		return false;
+	}
+
+	// the GPU buffers are fixed size, do not trust the coordinator to stay inside them
+	if (scene->materials.size() > sizeof(MaterialBuffer) / sizeof(RaytracingMaterial)
+		|| !TracingEngine::FitsBuffers(&scene->geometry))
+	{
+		TraceLog(LOG_ERROR, "WORKER: Scene does not fit the tracing buffers");
+		return false;
+	}
+
+	// nor to only reference entries that exist, the shader does no bounds checks
+	if (!HasValidIndices(scene))
+	{
+		TraceLog(LOG_ERROR, "WORKER: Scene references geometry, materials or textures it does not contain");
+		return false;
+	}
+
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(settings->width, settings->height, "raylib raytracer worker");
+
+	TracingEngine::Initialize(Vector2((float)settings->width, (float)settings->height), settings->maxBounces, settings->raysPerPixel, settings->blur);
+	TracingEngine::skyMaterial = scene->sky;
+	TracingEngine::denoise = true;
+	TracingEngine::pause = false;
+
+	// adding textures in the coordinator's order reproduces its texture indices
+	for (size_t i = 0; i < scene->textures.size(); i++)
+	{
+		TexturePixels* texture = &scene->textures[i];
+		Image image = { texture->rgba.data(), texture->width, texture->height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+		TracingEngine::AddTexture(image);
+	}
+
+	for (size_t i = 0; i < scene->materials.size(); i++)
+	{
+		TracingEngine::AddMaterial(scene->materials[i]);
+	}
+
+	TracingEngine::UploadStaticData();
+	TracingEngine::UploadGeometry(std::move(scene->geometry));
+
+	return true;
+}
+
+bool Worker::IsInsideFrame(RenderSettings* settings, WorkItem* item)
+{
+	return item->width > 0 && item->height > 0 && item->x >= 0 && item->y >= 0
+		&& item->x <= settings->width - item->width && item->y <= settings->height - item->height
+		&& item->firstPass >= 0 && item->passCount > 0;
+}
+
+TileResult Worker::RenderWorkItem(SceneMessage* scene, WorkItem* item)
+{
+	TracingEngine::ResetAccumulation();
+
+	for (int pass = item->firstPass; pass < item->firstPass + item->passCount; pass++)
+	{
+		Profiler::BeginFrame();
+
+		// the seed only depends on the pass, so any worker, or two racing for the same item, produce the same samples
+		TracingEngine::seed = scene->settings.seed + scene->frame + pass;
+		TracingEngine::UploadData(&scene->camera);
+		TracingEngine::AccumulateTile(item->x, item->y, item->width, item->height);
+	}
+
+	std::vector<float> rgba = TracingEngine::ReadAccumulation(item->x, item->y, item->width, item->height);
+
+	TileResult result = { item->id, item->passCount * scene->settings.raysPerPixel };
+	result.radiance.resize(item->width * item->height * 3);
+
+	for (int i = 0; i < item->width * item->height; i++)
+	{
+		result.radiance[i * 3 + 0] = rgba[i * 4 + 0];
+		result.radiance[i * 3 + 1] = rgba[i * 4 + 1];
+		result.radiance[i * 3 + 2] = rgba[i * 4 + 2];
+	}
+
+	return result;
+}
+
+int Worker::Run(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "usage: RaylibRaytracer --worker <coordinator host> [port]\n";
+		return 1;
+	}
+
+	const char* host = argv[2];
+	int port = argc > 3 ? atoi(argv[3]) : DISTRIBUTED_DEFAULT_PORT;
+
+	Socket::Startup();
+
+	// spawned workers may start before the coordinator is accepting, give it a moment
+	Socket coordinator;
+	for (int attempt = 0; attempt < 50 && !coordinator.IsValid(); attempt++)
+	{
+		coordinator = Socket::Connect(host, port);
+		if (!coordinator.IsValid()) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	if (!coordinator.IsValid())
+	{
+		TraceLog(LOG_ERROR, "WORKER: Failed to connect to %s:%i", host, port);
+		Socket::Shutdown();
+		return 1;
+	}
+
+	MessageType type;
+	std::vector<unsigned char> payload;
+	SceneMessage scene;
+
+	if (!Protocol::Receive(&coordinator, &type, &payload) || type != MESSAGE_SCENE || !Protocol::DeserializeScene(payload, &scene))
+	{
+		TraceLog(LOG_ERROR, "WORKER: Expected a scene from the coordinator");
+		coordinator.Close();
+		Socket::Shutdown();
+		return 1;
+	}
+
+	if (!LoadScene(&scene))
+	{
+		coordinator.Close();
+		Socket::Shutdown();
+		return 1;
+	}
+
+	int completed = 0;
+
+	while (Protocol::Send(&coordinator, MESSAGE_REQUEST, {}) && Protocol::Receive(&coordinator, &type, &payload))
+	{
+		WorkItem item;
+
+		if (type != MESSAGE_WORK || !Protocol::DeserializeWork(payload, &item))
+		{
+			break;
+		}
+
+		if (!IsInsideFrame(&scene.settings, &item))
+		{
+			TraceLog(LOG_ERROR, "WORKER: Work item %i lies outside the frame", item.id);
+			break;
+		}
+
+		TileResult result = RenderWorkItem(&scene, &item);
+
+		if (!Protocol::Send(&coordinator, MESSAGE_RESULT, Protocol::SerializeResult(result)))
+		{
+			break;
+		}
+
+		completed++;
+	}
+
+	TraceLog(LOG_INFO, "WORKER: Finished after %i work items", completed);
+
+	coordinator.Close();
+	Socket::Shutdown();
+
+	TracingEngine::Unload();
+	CloseWindow();
+
+	return 0;
+}
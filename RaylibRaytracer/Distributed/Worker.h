@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Protocol.h"
+
+// Render process of the distributed mode. Connects to a coordinator, loads the scene it ships once and then traces
+// whatever tiles and sample ranges it is handed until told to stop.
+class Worker
+{
+private:
+	static bool HasValidIndices(SceneMessage* scene);
+	static bool LoadScene(SceneMessage* scene);
+	static bool IsInsideFrame(RenderSettings* settings, WorkItem* item);
+	static TileResult RenderWorkItem(SceneMessage* scene, WorkItem* item);
+
+public:
+	static bool IsWorkerCommand(int argc, char** argv);
+	static int Run(int argc, char** argv);
+};
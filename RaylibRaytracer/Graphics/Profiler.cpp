@@ -0,0 +1,370 @@
+#include "Profiler.h"
+
+#include <external/glad.h>
+#include <rlgl.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+static const std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+static const Color zoneColors[] = { ORANGE, SKYBLUE, LIME, PURPLE, YELLOW, MAGENTA, RED, BLUE };
+
+void Profiler::Initialize()
+{
+	initialized = true;
+	mainThread = std::this_thread::get_id();
+	frame = 0;
+	frameStart = Now();
+
+	CalibrateGpuClock();
+}
+
+void Profiler::Unload()
+{
+	for (size_t i = 0; i < zones.size(); i++)
+	{
+		if (zones[i].type == PROFILE_ZONE_GPU)
+		{
+			glDeleteQueries(PROFILER_QUERY_LATENCY * 2, &zones[i].queries[0][0]);
+		}
+	}
+
+	zones.clear();
+	traceEvents.clear();
+	initialized = false;
+}
+
+double Profiler::Now()
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - profilerEpoch).count();
+}
+
+void Profiler::CalibrateGpuClock()
+{
+	// GL timestamps live on the GPU clock, so remember how far it is from ours to line both up in traces
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuTimeOffset = Now() - (double)gpuNow / 1000.0;
+}
+
+int Profiler::GetThreadId()
+{
+	// 0 is the main thread, 1 the GPU timeline, workers are numbered from 2 as they show up
+	thread_local int threadId = -1;
+
+	if (threadId < 0)
+	{
+		threadId = std::this_thread::get_id() == mainThread ? 0 : numThreads++;
+	}
+
+	return threadId;
+}
+
+int Profiler::GetZone(const char* name, ProfileZoneType type)
+{
+	for (size_t i = 0; i < zones.size(); i++)
+	{
+		if (zones[i].type == type && strcmp(zones[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+
+	ProfileZone zone = {};
+	zone.name = name;
+	zone.type = type;
+	zone.color = zoneColors[zones.size() % (sizeof(zoneColors) / sizeof(Color))];
+
+	for (int i = 0; i < PROFILER_QUERY_LATENCY; i++)
+	{
+		zone.queryFrame[i] = -1;
+	}
+
+	if (type == PROFILE_ZONE_GPU)
+	{
+		glGenQueries(PROFILER_QUERY_LATENCY * 2, &zone.queries[0][0]);
+	}
+
+	zones.push_back(zone);
+
+	return zones.size() - 1;
+}
+
+void Profiler::ResolveGpuZone(ProfileZone* zone, int slot)
+{
+	if (zone->queryFrame[slot] < 0)
+	{
+		return;
+	}
+
+	long long issuedFrame = zone->queryFrame[slot];
+	zone->queryFrame[slot] = -1;
+
+	// never block on the driver, a result that is still not ready after PROFILER_QUERY_LATENCY frames is dropped
+	GLint available = 0;
+	glGetQueryObjectiv(zone->queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+	if (!available)
+	{
+		return;
+	}
+
+	GLuint64 begin = 0;
+	GLuint64 end = 0;
+	glGetQueryObjectui64v(zone->queries[slot][0], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(zone->queries[slot][1], GL_QUERY_RESULT, &end);
+
+	zone->history[issuedFrame % PROFILER_HISTORY] = (float)((end - begin) / 1000000.0);
+
+	if (capturing && traceEvents.size() < PROFILER_MAX_TRACE_EVENTS)
+	{
+		traceEvents.push_back({ zone->name, 1, (double)begin / 1000.0 + gpuTimeOffset, (double)(end - begin) / 1000.0 });
+	}
+}
+
+void Profiler::BeginFrame()
+{
+	if (!initialized)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	double now = Now();
+
+	if (capturing && frame > 0 && traceEvents.size() < PROFILER_MAX_TRACE_EVENTS)
+	{
+		traceEvents.push_back({ "frame", 0, frameStart, now - frameStart });
+	}
+
+	frame++;
+	frameStart = now;
+
+	int slot = frame % PROFILER_QUERY_LATENCY;
+
+	for (size_t i = 0; i < zones.size(); i++)
+	{
+		if (zones[i].type == PROFILE_ZONE_GPU)
+		{
+			ResolveGpuZone(&zones[i], slot);
+		}
+
+		zones[i].history[frame % PROFILER_HISTORY] = 0;
+	}
+}
+
+void Profiler::BeginGpuZone(const char* name)
+{
+	if (!initialized)
+	{
+		return;
+	}
+
+	// raylib batches draw calls, flush them so the timestamp lands after the work that came before it
+	rlDrawRenderBatchActive();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	ProfileZone* zone = &zones[GetZone(name, PROFILE_ZONE_GPU)];
+	int slot = frame % PROFILER_QUERY_LATENCY;
+
+	glQueryCounter(zone->queries[slot][0], GL_TIMESTAMP);
+	zone->queryFrame[slot] = frame;
+}
+
+void Profiler::EndGpuZone(const char* name)
+{
+	if (!initialized)
+	{
+		return;
+	}
+
+	rlDrawRenderBatchActive();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	ProfileZone* zone = &zones[GetZone(name, PROFILE_ZONE_GPU)];
+	int slot = frame % PROFILER_QUERY_LATENCY;
+
+	glQueryCounter(zone->queries[slot][1], GL_TIMESTAMP);
+}
+
+void Profiler::AddCpuSample(const char* name, double start, double end)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// ids are handed out under the lock, threads can take their first sample at the same time
+	int threadId = GetThreadId();
+
+	ProfileZone* zone = &zones[GetZone(name, PROFILE_ZONE_CPU)];
+	zone->history[frame % PROFILER_HISTORY] += (float)((end - start) / 1000.0);
+
+	if (capturing && traceEvents.size() < PROFILER_MAX_TRACE_EVENTS)
+	{
+		traceEvents.push_back({ name, threadId, start, end - start });
+	}
+}
+
+float Profiler::GetAverage(const char* name)
+{
+	for (size_t i = 0; i < zones.size(); i++)
+	{
+		if (strcmp(zones[i].name, name) != 0)
+		{
+			continue;
+		}
+
+		long long newest = zones[i].type == PROFILE_ZONE_GPU ? frame - PROFILER_QUERY_LATENCY : frame - 1;
+		long long count = std::min<long long>(newest, PROFILER_HISTORY - PROFILER_QUERY_LATENCY);
+
+		if (count <= 0)
+		{
+			return 0;
+		}
+
+		float total = 0;
+		for (long long f = newest - count + 1; f <= newest; f++)
+		{
+			total += zones[i].history[f % PROFILER_HISTORY];
+		}
+
+		return total / count;
+	}
+
+	return 0;
+}
+
+void Profiler::BeginCapture()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	traceEvents.clear();
+	CalibrateGpuClock();
+	capturing = true;
+}
+
+bool Profiler::EndCapture(const char* path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	capturing = false;
+
+	std::ofstream file(path);
+
+	if (!file.is_open())
+	{
+		traceEvents.clear();
+		return false;
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+
+	for (int i = 2; i < numThreads; i++)
+	{
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i << ",\"args\":{\"name\":\"Worker " << i - 1 << "\"}}";
+	}
+
+	file.precision(3);
+	file << std::fixed;
+
+	for (size_t i = 0; i < traceEvents.size(); i++)
+	{
+		TraceEvent* e = &traceEvents[i];
+		file << ",\n{\"name\":\"" << e->name << "\",\"cat\":\"" << (e->tid == 1 ? "gpu" : "cpu")
+			<< "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e->tid << ",\"ts\":" << e->start << ",\"dur\":" << e->duration << "}";
+	}
+
+	file << "\n]}\n";
+
+	traceEvents.clear();
+	return file.good();
+}
+
+bool Profiler::IsCapturing()
+{
+	return capturing;
+}
+
+void Profiler::DrawGraph(ProfileZoneType type, const char* label, int x, int y, int width, int height)
+{
+	const float msRange = 33.3f;
+	const int legendWidth = 220;
+
+	int graphWidth = width - legendWidth;
+	float barWidth = (float)graphWidth / PROFILER_HISTORY;
+	long long newest = type == PROFILE_ZONE_GPU ? frame - PROFILER_QUERY_LATENCY : frame - 1;
+
+	DrawRectangle(x, y, width, height, Fade(BLACK, 0.6f));
+
+	for (int i = 0; i < PROFILER_HISTORY - PROFILER_QUERY_LATENCY; i++)
+	{
+		long long f = newest - i;
+
+		if (f < 1)
+		{
+			break;
+		}
+
+		float barX = x + graphWidth - (i + 1) * barWidth;
+		float barBottom = (float)(y + height);
+
+		for (size_t z = 0; z < zones.size(); z++)
+		{
+			if (zones[z].type != type)
+			{
+				continue;
+			}
+
+			float barHeight = zones[z].history[f % PROFILER_HISTORY] / msRange * height;
+			barHeight = std::min(barHeight, barBottom - y);
+			DrawRectangleRec(Rectangle(barX, barBottom - barHeight, std::max(barWidth, 1.0f), barHeight), zones[z].color);
+			barBottom -= barHeight;
+		}
+	}
+
+	// 60 fps budget
+	int budgetY = y + height - (int)(16.6f / msRange * height);
+	DrawLine(x, budgetY, x + graphWidth, budgetY, Fade(WHITE, 0.5f));
+
+	DrawText(label, x + 5, y + 5, 10, WHITE);
+
+	int legendY = y + 5;
+	for (size_t z = 0; z < zones.size(); z++)
+	{
+		if (zones[z].type != type)
+		{
+			continue;
+		}
+
+		DrawText(TextFormat("%s: %.2f ms", zones[z].name, GetAverage(zones[z].name)), x + graphWidth + 10, legendY, 10, zones[z].color);
+		legendY += 12;
+	}
+}
+
+void Profiler::Draw(int x, int y, int width, int height)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	int graphHeight = (height - 5) / 2;
+
+	DrawGraph(PROFILE_ZONE_GPU, "GPU", x, y, width, graphHeight);
+	DrawGraph(PROFILE_ZONE_CPU, "CPU", x, y + graphHeight + 5, width, graphHeight);
+
+	if (capturing) DrawText("TRACE CAPTURE ACTIVE", x, y + height + 5, 20, RED);
+}
+
+ProfileScope::ProfileScope(const char* name)
+{
+	this->name = name;
+	start = Profiler::Now();
+}
+
+ProfileScope::~ProfileScope()
+{
+	Profiler::AddCpuSample(name, start, Profiler::Now());
+}
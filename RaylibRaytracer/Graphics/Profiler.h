@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <raylib.h>
+
+#define PROFILER_HISTORY 240
+#define PROFILER_QUERY_LATENCY 4
+#define PROFILER_MAX_TRACE_EVENTS 200000
+
+enum ProfileZoneType
+{
+	PROFILE_ZONE_CPU,
+	PROFILE_ZONE_GPU
+};
+
+struct ProfileZone
+{
+	const char* name;
+	ProfileZoneType type;
+	Color color;
+	float history[PROFILER_HISTORY];                    // milliseconds per frame, indexed by frame % PROFILER_HISTORY
+	unsigned int queries[PROFILER_QUERY_LATENCY][2];    // begin/end GL timestamp queries, one pair per frame in flight
+	long long queryFrame[PROFILER_QUERY_LATENCY];       // frame a query pair was issued in, -1 when idle
+};
+
+struct TraceEvent
+{
+	const char* name;
+	int tid;
+	double start;       // microseconds since profiler start
+	double duration;    // microseconds
+};
+
+class Profiler
+{
+private:
+	inline static std::vector<ProfileZone> zones;
+	inline static std::vector<TraceEvent> traceEvents;
+
+	// CPU samples may come from worker threads, GPU zones only ever from the thread owning the GL context
+	inline static std::mutex mutex;
+	inline static std::thread::id mainThread;
+	inline static int numThreads = 2;
+
+	inline static long long frame = 0;
+	inline static double frameStart = 0;
+	inline static double gpuTimeOffset = 0;
+
+	inline static bool initialized = false;
+	inline static bool capturing = false;
+
+	static int GetZone(const char* name, ProfileZoneType type);
+	static int GetThreadId();
+	static void ResolveGpuZone(ProfileZone* zone, int slot);
+	static void CalibrateGpuClock();
+	static void DrawGraph(ProfileZoneType type, const char* label, int x, int y, int width, int height);
+
+public:
+	static void Initialize();
+	static void Unload();
+
+	static double Now();
+
+	static void BeginFrame();
+
+	static void BeginGpuZone(const char* name);
+	static void EndGpuZone(const char* name);
+	static void AddCpuSample(const char* name, double start, double end);
+
+	static float GetAverage(const char* name);
+
+	static void BeginCapture();
+	static bool EndCapture(const char* path);
+	static bool IsCapturing();
+
+	static void Draw(int x, int y, int width, int height);
+};
+
+struct ProfileScope
+{
+	const char* name;
+	double start;
+
+	ProfileScope(const char* name);
+	~ProfileScope();
+};
+
+#define PROFILE_SCOPE(name) ProfileScope profileScope(name)
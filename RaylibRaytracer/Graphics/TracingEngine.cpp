@@ -1,8 +1,29 @@
 #include "TracingEngine.h"
+#include "Profiler.h"
 
+#include <external/glad.h>
 #include <rlgl.h>
 #include <raymath.h>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+
+template<typename T>
+void TracingEngine::SetFrameConstant(T* field, T value)
+{
+	if (memcmp(field, &value, sizeof(T)) == 0)
+	{
+		return;
+	}
+
+	*field = value;
+
+	int begin = (char*)field - (char*)&frameConstants;
+	int end = begin + sizeof(T);
+
+	frameConstantsDirtyBegin = frameConstantsDirtyEnd > frameConstantsDirtyBegin ? std::min(frameConstantsDirtyBegin, begin) : begin;
+	frameConstantsDirtyEnd = std::max(frameConstantsDirtyEnd, end);
+}
 
 void TracingEngine::Initialize(Vector2 resolution, int maxBounces, int raysPerPixel, float blur)
 {
@@ -12,42 +33,61 @@ void TracingEngine::Initialize(Vector2 resolution, int maxBounces, int raysPerPi
 	TracingEngine::raysPerPixel = raysPerPixel;
 	TracingEngine::blur = blur;
 
-	raytracingRenderTexture = LoadRenderTexture(resolution.x, resolution.y);
-	previouseFrameRenderTexture = LoadRenderTexture(resolution.x, resolution.y);
+	raytracingRenderTexture = LoadFloatRenderTexture(resolution.x, resolution.y);
+	previouseFrameRenderTexture = LoadFloatRenderTexture(resolution.x, resolution.y);
 
 	raytracingShader = LoadShader(0, TextFormat("resources/shaders/raytracer_fragment.glsl", 430));
 	postShader = LoadShader(0, TextFormat("resources/shaders/post_fragment.glsl", 430));
 
-	tracingParams.cameraPosition = GetShaderLocation(raytracingShader, "cameraPosition");
-	tracingParams.cameraDirection = GetShaderLocation(raytracingShader, "cameraDirection");
-	tracingParams.screenCenter = GetShaderLocation(raytracingShader, "screenCenter");
-	tracingParams.viewParams = GetShaderLocation(raytracingShader, "viewParams");
-	tracingParams.resolution = GetShaderLocation(raytracingShader, "resolution");
-	tracingParams.numRenderedFrames = GetShaderLocation(raytracingShader, "numRenderedFrames");
-	tracingParams.previousFrame = GetShaderLocation(raytracingShader, "previousFrame");
-	tracingParams.raysPerPixel = GetShaderLocation(raytracingShader, "raysPerPixel");
-	tracingParams.maxBounces = GetShaderLocation(raytracingShader, "maxBounces");
-	tracingParams.denoise = GetShaderLocation(raytracingShader, "denoise");
-	tracingParams.blur = GetShaderLocation(raytracingShader, "blur");
-	tracingParams.pause = GetShaderLocation(raytracingShader, "pause");
-
 	postParams.resolution = GetShaderLocation(postShader, "resolution");
-	postParams.denoise = GetShaderLocation(postShader, "denoise");
-
-	Vector2 screenCenter = Vector2(resolution.x / 2.0f, resolution.y / 2.0f);
-	SetShaderValue(raytracingShader, tracingParams.screenCenter, &screenCenter, SHADER_UNIFORM_VEC2);
-	SetShaderValue(raytracingShader, tracingParams.resolution, &resolution, SHADER_UNIFORM_VEC2);
-
 	SetShaderValue(postShader, postParams.resolution, &resolution, SHADER_UNIFORM_VEC2);
 
-	SetShaderValue(raytracingShader, tracingParams.raysPerPixel, &raysPerPixel, SHADER_UNIFORM_INT);
-	SetShaderValue(raytracingShader, tracingParams.maxBounces, &maxBounces, SHADER_UNIFORM_INT);
-	SetShaderValue(raytracingShader, tracingParams.blur, &blur, SHADER_UNIFORM_FLOAT);
+	frameConstants = {};
+	glGenBuffers(1, &frameConstantsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameConstantsUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), &frameConstants, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, frameConstantsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	SetFrameConstant(&frameConstants.resolution, resolution);
+	SetFrameConstant(&frameConstants.screenCenter, Vector2(resolution.x / 2.0f, resolution.y / 2.0f));
+	SetFrameConstant(&frameConstants.raysPerPixel, raysPerPixel);
+	SetFrameConstant(&frameConstants.maxBounces, maxBounces);
+	SetFrameConstant(&frameConstants.blur, blur);
 
 	sphereSSBO = rlLoadShaderBuffer(sizeof(SphereBuffer), NULL, RL_DYNAMIC_COPY);
 	meshesSSBO = rlLoadShaderBuffer(sizeof(MeshBuffer), NULL, RL_DYNAMIC_COPY);
 	trianglesSSBO = rlLoadShaderBuffer(sizeof(TriangleBuffer), NULL, RL_DYNAMIC_COPY);
+	triangleUVsSSBO = rlLoadShaderBuffer(sizeof(TriangleUVBuffer), NULL, RL_DYNAMIC_COPY);
 	nodesSSBO = rlLoadShaderBuffer(sizeof(NodeBuffer), NULL, RL_DYNAMIC_COPY);
+	materialsSSBO = rlLoadShaderBuffer(sizeof(MaterialBuffer), NULL, RL_DYNAMIC_COPY);
+
+	Profiler::Initialize();
+}
+
+RenderTexture2D TracingEngine::LoadFloatRenderTexture(int width, int height)
+{
+	// 8 bit targets lose everything below 1/255 once many frames are averaged, accumulate in full float instead
+	RenderTexture2D target = LoadRenderTexture(width, height);
+
+	unsigned int colorTexture = rlLoadTexture(NULL, width, height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+	rlFramebufferAttach(target.id, colorTexture, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+
+	if (!rlFramebufferComplete(target.id))
+	{
+		// keep the 8 bit target rather than hand back an incomplete framebuffer
+		TraceLog(LOG_WARNING, "TRACING: Float render targets unsupported, accumulating in 8 bit");
+		rlFramebufferAttach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+		rlUnloadTexture(colorTexture);
+		return target;
+	}
+
+	rlUnloadTexture(target.texture.id);
+
+	target.texture.id = colorTexture;
+	target.texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+
+	return target;
 }
 
 Vector3 TracingEngine::TriangleCenter(Triangle* triangle)
@@ -86,53 +126,54 @@ float TracingEngine::TriangleCenterOnAxis(Triangle* triangle, int axis)
 	}
 }
 
-void TracingEngine::SplitNode(int parentIndex, int depth, int maxDepth)
+void TracingEngine::SplitNode(SceneGeometry* geometry, int parentIndex, int depth, int maxDepth)
 {
 	if (depth == maxDepth)
 	{
 		return;
 	}
 
-	nodes[parentIndex].childIndex = nodes.size();
+	geometry->nodes[parentIndex].childIndex = geometry->nodes.size();
 
-	Vector3 size = nodes[parentIndex].bounds.max - nodes[parentIndex].bounds.min;
+	Vector3 size = geometry->nodes[parentIndex].bounds.max - geometry->nodes[parentIndex].bounds.min;
 	int splitAxis = size.x > std::max(size.y, size.z) ? 0 : size.y > size.z ? 1 : 2;
-	float splitPos = BoundingBoxCenterOnAxis(&nodes[parentIndex].bounds, splitAxis);
+	float splitPos = BoundingBoxCenterOnAxis(&geometry->nodes[parentIndex].bounds, splitAxis);
 
-	Node childA = { .triangleIndex = nodes[parentIndex].triangleIndex };
-	Node childB = { .triangleIndex = nodes[parentIndex].triangleIndex };
+	Node childA = { .triangleIndex = geometry->nodes[parentIndex].triangleIndex };
+	Node childB = { .triangleIndex = geometry->nodes[parentIndex].triangleIndex };
 
-	childA.bounds.min = BoundingBoxCenter(&nodes[parentIndex].bounds);
-	childA.bounds.max = BoundingBoxCenter(&nodes[parentIndex].bounds);
+	childA.bounds.min = BoundingBoxCenter(&geometry->nodes[parentIndex].bounds);
+	childA.bounds.max = BoundingBoxCenter(&geometry->nodes[parentIndex].bounds);
 
-	childB.bounds.min = BoundingBoxCenter(&nodes[parentIndex].bounds);
-	childB.bounds.max = BoundingBoxCenter(&nodes[parentIndex].bounds);
+	childB.bounds.min = BoundingBoxCenter(&geometry->nodes[parentIndex].bounds);
+	childB.bounds.max = BoundingBoxCenter(&geometry->nodes[parentIndex].bounds);
 
-	for (int i = 0; i < nodes[parentIndex].numTriangles; i++)
+	for (int i = 0; i < geometry->nodes[parentIndex].numTriangles; i++)
 	{
-		int triIndex = nodes[parentIndex].triangleIndex + i;
-		bool isSideA = TriangleCenterOnAxis(&triangles[triIndex], splitAxis) < splitPos;
+		int triIndex = geometry->nodes[parentIndex].triangleIndex + i;
+		bool isSideA = TriangleCenterOnAxis(&geometry->triangles[triIndex], splitAxis) < splitPos;
 		Node* child = isSideA ? &childA : &childB;
 
-		GrowToIncludeTriangle(&child->bounds, triangles[triIndex]);
+		GrowToIncludeTriangle(&child->bounds, geometry->triangles[triIndex]);
 		child->numTriangles++;
 
 		if (isSideA)
 		{
 			int swap = child->triangleIndex + child->numTriangles - 1;
-			std::swap(triangles[triIndex], triangles[swap]);
+			std::swap(geometry->triangles[triIndex], geometry->triangles[swap]);
+			std::swap(geometry->uvs[triIndex], geometry->uvs[swap]);
 			childB.triangleIndex++;
 		}
 	}
 
-	int childIndexA = nodes.size();
-	int childIndexB = nodes.size() + 1;
+	int childIndexA = geometry->nodes.size();
+	int childIndexB = geometry->nodes.size() + 1;
 
-	nodes.push_back(childA);
-	nodes.push_back(childB);
+	geometry->nodes.push_back(childA);
+	geometry->nodes.push_back(childB);
 
-	SplitNode(childIndexA, depth + 1, maxDepth);
-	SplitNode(childIndexB, depth + 1, maxDepth);
+	SplitNode(geometry, childIndexA, depth + 1, maxDepth);
+	SplitNode(geometry, childIndexB, depth + 1, maxDepth);
 }
 
 PaddedBoundingBox TracingEngine::GetMeshPaddedBoundingBox(Mesh mesh)
@@ -172,75 +213,321 @@ Vector4 TracingEngine::ColorToVector4(Color color)
 
 void TracingEngine::UploadSky()
 {
-	unsigned int skyColorZenithLocation = GetShaderLocation(raytracingShader, "skyMaterial.skyColorZenith");
-	unsigned int skyColorHorizonLocation = GetShaderLocation(raytracingShader, "skyMaterial.skyColorHorizon");
-	unsigned int groundColorLocation = GetShaderLocation(raytracingShader, "skyMaterial.groundColor");
-	unsigned int sunColorLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunColor");
-	unsigned int sunDirectionLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunDirection");
-	unsigned int sunFocusLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunFocus");
-	unsigned int sunIntensityLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunIntensity");
+	PROFILE_SCOPE("UploadSky");
+
+	SkyConstants sky = {};
+	sky.skyColorZenith = ColorToVector4(skyMaterial.skyColorZenith);
+	sky.skyColorHorizon = ColorToVector4(skyMaterial.skyColorHorizon);
+	sky.groundColor = ColorToVector4(skyMaterial.groundColor);
+	sky.sunColor = ColorToVector4(skyMaterial.sunColor);
+	sky.sunDirection = skyMaterial.sunDirection;
+	sky.sunFocus = skyMaterial.sunFocus;
+	sky.sunIntensity = skyMaterial.sunIntensity;
+
+	SetFrameConstant(&frameConstants.sky, sky);
+}
+
+void TracingEngine::FlushFrameConstants()
+{
+	if (frameConstantsDirtyEnd <= frameConstantsDirtyBegin)
+	{
+		return;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frameConstantsUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, frameConstantsDirtyBegin, frameConstantsDirtyEnd - frameConstantsDirtyBegin, (char*)&frameConstants + frameConstantsDirtyBegin);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	frameConstantsDirtyBegin = 0;
+	frameConstantsDirtyEnd = 0;
+}
+
+int TracingEngine::AddMaterial(RaytracingMaterial material)
+{
+	if (totalMaterials == sizeof(MaterialBuffer) / sizeof(RaytracingMaterial))
+	{
+		TraceLog(LOG_ERROR, "TRACING: Material limit of %i reached", totalMaterials);
+		return -1;
+	}
+
+	SetMaterial(totalMaterials, material);
+	return totalMaterials++;
+}
 
-	Vector4 skyColorZenith = ColorToVector4(skyMaterial.skyColorZenith);
-	SetShaderValue(raytracingShader, skyColorZenithLocation, &skyColorZenith, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+void TracingEngine::SetMaterial(int materialIndex, RaytracingMaterial material)
+{
+	if (materialIndex < 0 || materialIndex >= sizeof(MaterialBuffer) / sizeof(RaytracingMaterial))
+	{
+		return;
+	}
 
-	Vector4 skyColorHorizon = ColorToVector4(skyMaterial.skyColorHorizon);
-	SetShaderValue(raytracingShader, skyColorHorizonLocation, &skyColorHorizon, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+	materialBuffer.materials[materialIndex] = material;
 
-	Vector4 groundColor = ColorToVector4(skyMaterial.groundColor);
-	SetShaderValue(raytracingShader, groundColorLocation, &groundColor, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+	materialsDirtyBegin = materialsDirtyEnd > materialsDirtyBegin ? std::min(materialsDirtyBegin, materialIndex) : materialIndex;
+	materialsDirtyEnd = std::max(materialsDirtyEnd, materialIndex + 1);
+}
 
-	Vector4 sunColor = ColorToVector4(skyMaterial.sunColor);
-	SetShaderValue(raytracingShader, sunColorLocation, &sunColor, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+RaytracingMaterial TracingEngine::GetMaterial(int materialIndex)
+{
+	return materialBuffer.materials[materialIndex];
+}
 
-	SetShaderValue(raytracingShader, sunDirectionLocation, &skyMaterial.sunDirection, SHADER_UNIFORM_VEC3);   // Set shader uniform value vector
-	SetShaderValue(raytracingShader, sunFocusLocation, &skyMaterial.sunFocus, SHADER_UNIFORM_FLOAT);
-	SetShaderValue(raytracingShader, sunIntensityLocation, &skyMaterial.sunIntensity, SHADER_UNIFORM_FLOAT);
+int TracingEngine::GetMaterialCount()
+{
+	return totalMaterials;
 }
 
-void TracingEngine::GenerateBVHS()
+int TracingEngine::AddRaylibMaterial(Material material)
 {
-	int triangleOffset = 0;
+	MaterialMap albedo = material.maps[MATERIAL_MAP_ALBEDO];
+
+	RaytracingMaterial result = {};
+	result.color = ColorToVector4(albedo.color);
 
-	for (int i = 0; i < meshes.size(); i++)
+	// untextured raylib materials still point at its 1x1 white default texture
+	if (albedo.texture.id != 0 && albedo.texture.id != rlGetTextureIdDefault())
 	{
-		RaytracingMesh mesh = meshes[i];
+		Image image = LoadImageFromTexture(albedo.texture);
+		result.textureIndex = AddTexture(image);
+		UnloadImage(image);
+	}
 
-		PaddedBoundingBox bounds{};
-		bounds.min = Vector3(mesh.boundingMin.x, mesh.boundingMin.y, mesh.boundingMin.z);
-		bounds.max = Vector3(mesh.boundingMax.x, mesh.boundingMax.y, mesh.boundingMax.z);
+	return AddMaterial(result);
+}
 
-		Node root = { .bounds = bounds, .triangleIndex = mesh.firstTriangleIndex, .numTriangles = mesh.numTriangles };
+std::vector<int> TracingEngine::AddRaylibMaterials(Model model)
+{
+	std::vector<int> materialIndices;
 
-		nodes.push_back(root);
+	for (int i = 0; i < model.materialCount; i++)
+	{
+		materialIndices.push_back(AddRaylibMaterial(model.materials[i]));
+	}
 
-		meshes[i].rootNodeIndex = nodes.size() - 1;
+	return materialIndices;
+}
 
-		triangleOffset += mesh.numTriangles;
+int TracingEngine::AddTexture(Image image)
+{
+	if (image.data == nullptr)
+	{
+		return 0;
+	}
 
-		SplitNode(nodes.size() - 1, 0, meshes[i].bvhDepth);
+	if (textures.size() == MAX_TEXTURE_LAYERS)
+	{
+		TraceLog(LOG_WARNING, "TRACING: Texture limit of %i reached", MAX_TEXTURE_LAYERS);
+		return 0;
 	}
 
-	for (int i = 0; i < nodes.size(); i++)
+	// base level only, mips are generated for the whole array
+	Image texture = ImageFromImage(image, Rectangle(0, 0, (float)image.width, (float)image.height));
+	ImageFormat(&texture, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+	// only ever shrink here, small textures are resampled to the shared layer size at upload
+	if (texture.width > MAX_TEXTURE_SIZE || texture.height > MAX_TEXTURE_SIZE)
 	{
-		nodeBuffer.nodes[i] = nodes[i];
+		float scale = (float)MAX_TEXTURE_SIZE / std::max(texture.width, texture.height);
+		ImageResize(&texture, std::max(1, (int)(texture.width * scale)), std::max(1, (int)(texture.height * scale)));
+	}
+
+	textures.push_back(texture);
+
+	int layer = textures.size() - 1;
+	texturesDirtyBegin = texturesDirtyEnd > texturesDirtyBegin ? texturesDirtyBegin : layer;
+	texturesDirtyEnd = layer + 1;
+
+	return textures.size();
+}
+
+const std::vector<Image>& TracingEngine::GetTextures()
+{
+	return textures;
+}
+
+void TracingEngine::UploadTextures()
+{
+	if (texturesDirtyEnd <= texturesDirtyBegin)
+	{
+		return;
+	}
+
+	// every layer has the size of the largest texture, a power of two so each mip level halves cleanly
+	int layerSize = 1;
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		while (layerSize < std::max(textures[i].width, textures[i].height)) layerSize *= 2;
+	}
+
+	if (textureArray == 0 || layerSize != textureArraySize || (int)textures.size() > textureArrayLayers)
+	{
+		// storage is immutable and sized to the textures actually used, rebuild it and upload every layer again
+		if (textureArray != 0)
+		{
+			glDeleteTextures(1, &textureArray);
+		}
+
+		int levels = 1;
+		while ((layerSize >> levels) > 0) levels++;
+
+		glGenTextures(1, &textureArray);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, layerSize, layerSize, textures.size());
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+		textureArraySize = layerSize;
+		textureArrayLayers = textures.size();
+		texturesDirtyBegin = 0;
+		texturesDirtyEnd = textures.size();
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+
+	for (int i = texturesDirtyBegin; i < texturesDirtyEnd; i++)
+	{
+		if (textures[i].width == layerSize && textures[i].height == layerSize)
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, layerSize, layerSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, textures[i].data);
+			continue;
+		}
+
+		// UVs are normalized, so resampling to the layer size keeps them valid
+		Image layer = ImageCopy(textures[i]);
+		ImageResize(&layer, layerSize, layerSize);
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, layerSize, layerSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data);
+		UnloadImage(layer);
+	}
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	texturesDirtyBegin = 0;
+	texturesDirtyEnd = 0;
+}
+
+void TracingEngine::UploadMaterials()
+{
+	if (materialsDirtyEnd <= materialsDirtyBegin)
+	{
+		return;
+	}
+
+	unsigned int offset = materialsDirtyBegin * sizeof(RaytracingMaterial);
+	unsigned int size = (materialsDirtyEnd - materialsDirtyBegin) * sizeof(RaytracingMaterial);
+	rlUpdateShaderBuffer(materialsSSBO, &materialBuffer.materials[materialsDirtyBegin], size, offset);
+
+	materialsDirtyBegin = 0;
+	materialsDirtyEnd = 0;
+}
+
+void TracingEngine::GenerateBVHS(SceneGeometry* geometry)
+{
+	PROFILE_SCOPE("GenerateBVHS");
+
+	for (int i = 0; i < geometry->meshes.size(); i++)
+	{
+		RaytracingMesh mesh = geometry->meshes[i];
+
+		PaddedBoundingBox bounds{};
+		bounds.min = Vector3(mesh.boundingMin.x, mesh.boundingMin.y, mesh.boundingMin.z);
+		bounds.max = Vector3(mesh.boundingMax.x, mesh.boundingMax.y, mesh.boundingMax.z);
+
+		Node root = { .bounds = bounds, .triangleIndex = mesh.firstTriangleIndex, .numTriangles = mesh.numTriangles };
+
+		geometry->nodes.push_back(root);
+
+		geometry->meshes[i].rootNodeIndex = geometry->nodes.size() - 1;
+
+		SplitNode(geometry, geometry->nodes.size() - 1, 0, geometry->meshes[i].bvhDepth);
 	}
 }
 
 void TracingEngine::UploadSSBOS()
 {
+	PROFILE_SCOPE("UploadSSBOS");
+
 	rlUpdateShaderBuffer(sphereSSBO, &sphereBuffer, sizeof(SphereBuffer), 0);
 	rlUpdateShaderBuffer(meshesSSBO, &meshBuffer, sizeof(MeshBuffer), 0);
-	rlUpdateShaderBuffer(trianglesSSBO, &triangleBuffer, sizeof(TriangleBuffer), 0);
-	rlUpdateShaderBuffer(nodesSSBO, &nodeBuffer, sizeof(NodeBuffer), 0);
+
+	// only the used part of the large buffers, nodes never reference past it
+	rlUpdateShaderBuffer(trianglesSSBO, &triangleBuffer, geometry.triangles.size() * sizeof(Triangle), 0);
+	rlUpdateShaderBuffer(triangleUVsSSBO, geometry.uvs.data(), geometry.uvs.size() * sizeof(TriangleUVs), 0);
+	rlUpdateShaderBuffer(nodesSSBO, &nodeBuffer, geometry.nodes.size() * sizeof(Node), 0);
 
 	rlEnableShader(raytracingShader.id);
 	rlBindShaderBuffer(sphereSSBO, 1);
 	rlBindShaderBuffer(meshesSSBO, 2);
 	rlBindShaderBuffer(trianglesSSBO, 3);
 	rlBindShaderBuffer(nodesSSBO, 4);
+	rlBindShaderBuffer(materialsSSBO, 7);
+	rlBindShaderBuffer(triangleUVsSSBO, 8);
 	rlDisableShader();
 }
 
+void TracingEngine::LoadHeatmapBuffers()
+{
+	// only allocated once the heatmap is first switched on
+	traversalStatsBuffer.resize(resolution.y + 1);
+
+	for (int i = 0; i < TRAVERSAL_STATS_LATENCY; i++)
+	{
+		traversalStatsSSBOs[i] = rlLoadShaderBuffer(traversalStatsBuffer.size() * sizeof(TraversalCounters), NULL, RL_DYNAMIC_COPY);
+	}
+}
+
+void TracingEngine::ReduceTraversalStats(int slot)
+{
+	PROFILE_SCOPE("ReduceTraversalStats");
+
+	unsigned int size = traversalStatsBuffer.size() * sizeof(TraversalCounters);
+	GLsync fence = (GLsync)traversalStatsFences[slot];
+	bool ready = false;
+
+	if (fence != nullptr)
+	{
+		// never block on the driver, stats still in flight after TRAVERSAL_STATS_LATENCY frames are dropped
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		ready = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+
+		glDeleteSync(fence);
+		traversalStatsFences[slot] = nullptr;
+	}
+
+	if (ready)
+	{
+		rlReadShaderBuffer(traversalStatsSSBOs[slot], traversalStatsBuffer.data(), size, 0);
+
+		// first entry holds the maxima, the rest are per row totals
+		unsigned long long nodeVisits = 0;
+		unsigned long long boxTests = 0;
+		unsigned long long triangleTests = 0;
+
+		for (size_t i = 1; i < traversalStatsBuffer.size(); i++)
+		{
+			nodeVisits += traversalStatsBuffer[i].nodeVisits;
+			boxTests += traversalStatsBuffer[i].boxTests;
+			triangleTests += traversalStatsBuffer[i].triangleTests;
+		}
+
+		float numPixels = resolution.x * resolution.y;
+
+		traversalStats.averageNodeVisits = nodeVisits / numPixels;
+		traversalStats.averageBoxTests = boxTests / numPixels;
+		traversalStats.averageTriangleTests = triangleTests / numPixels;
+		traversalStats.max = traversalStatsBuffer[0];
+	}
+
+	// this slot is traced into again this frame
+	std::fill(traversalStatsBuffer.begin(), traversalStatsBuffer.end(), TraversalCounters{});
+	rlUpdateShaderBuffer(traversalStatsSSBOs[slot], traversalStatsBuffer.data(), size, 0);
+	rlBindShaderBuffer(traversalStatsSSBOs[slot], 6);
+}
+
 void TracingEngine::UploadSpheres()
 {
 	for (size_t i = 0; i < spheres.size(); i++)
@@ -251,26 +538,53 @@ void TracingEngine::UploadSpheres()
 
 void TracingEngine::UploadTriangles()
 {
-	for (size_t i = 0; i < triangles.size(); i++)
+	for (size_t i = 0; i < geometry.triangles.size(); i++)
 	{
-		triangleBuffer.triangles[i] = triangles[i];
+		triangleBuffer.triangles[i] = geometry.triangles[i];
 	}
 }
 
 void TracingEngine::UploadMeshes()
 {
-	for (size_t i = 0; i < meshes.size(); i++)
+	meshBuffer = {};
+
+	for (size_t i = 0; i < geometry.meshes.size(); i++)
 	{
-		meshBuffer.meshes[i] = meshes[i];
+		meshBuffer.meshes[i] = geometry.meshes[i];
 	}
 }
 
-void TracingEngine::UploadRaylibModel(Model model, RaytracingMaterial material, bool indexed, int bvhDepth)
+void TracingEngine::UploadNodes()
 {
+	for (size_t i = 0; i < geometry.nodes.size(); i++)
+	{
+		nodeBuffer.nodes[i] = geometry.nodes[i];
+	}
+}
+
+void TracingEngine::AppendRaylibModel(SceneGeometry* geometry, Model model, int materialIndex, bool indexed, int bvhDepth)
+{
+	AppendRaylibModel(geometry, model, std::vector<int>(std::max(model.materialCount, 1), materialIndex), indexed, bvhDepth);
+}
+
+void TracingEngine::AppendRaylibModel(SceneGeometry* geometry, Model model, const std::vector<int>& modelMaterials, bool indexed, int bvhDepth)
+{
+	PROFILE_SCOPE("AppendRaylibModel");
+
 	for (int m = 0; m < model.meshCount; m++)
 	{
 		Mesh mesh = model.meshes[m];
 
+		// modelMaterials maps the model's own material slots to material indices, anything unmapped falls back to material 0
+		int materialIndex = modelMaterials.empty() ? 0 : modelMaterials[0];
+
+		if (model.meshMaterial != nullptr && model.meshMaterial[m] >= 0 && model.meshMaterial[m] < (int)modelMaterials.size())
+		{
+			materialIndex = modelMaterials[model.meshMaterial[m]];
+		}
+
+		materialIndex = std::max(materialIndex, 0);
+
 		BoundingBox bounds = GetMeshBoundingBox(mesh);
 		Vector3 position;
 		Quaternion rotation;
@@ -280,7 +594,7 @@ void TracingEngine::UploadRaylibModel(Model model, RaytracingMaterial material,
 		bounds.min += position;
 		bounds.max += position;
 
-		int firstTriIndex = totalTriangles;
+		int firstTriIndex = geometry->triangles.size();
 
 		if (indexed)
 		{
@@ -315,8 +629,18 @@ void TracingEngine::UploadRaylibModel(Model model, RaytracingMaterial material,
 				tri.normalB = tempB;
 				tri.normalC = tempC;
 
-				triangles.push_back(tri);
-				totalTriangles++;
+				// Assign UVs from the texcoords array, if the mesh has one
+				TriangleUVs uvs = {};
+
+				if (mesh.texcoords != nullptr)
+				{
+					uvs.uvA = *(Vector2*)&mesh.texcoords[idx1 * 2];       // 2 floats per UV
+					uvs.uvB = *(Vector2*)&mesh.texcoords[idx2 * 2];
+					uvs.uvC = *(Vector2*)&mesh.texcoords[idx3 * 2];
+				}
+
+				geometry->triangles.push_back(tri);
+				geometry->uvs.push_back(uvs);
 			}
 		}
 		else
@@ -352,41 +676,148 @@ void TracingEngine::UploadRaylibModel(Model model, RaytracingMaterial material,
 				tri.normalB = tempB;
 				tri.normalC = tempC;
 
-				triangles.push_back(tri);
-				totalTriangles++;
+				// Assign UVs from the texcoords array, if the mesh has one
+				TriangleUVs uvs = {};
+
+				if (mesh.texcoords != nullptr)
+				{
+					uvs.uvA = *(Vector2*)&mesh.texcoords[idx1 * 2];       // 2 floats per UV
+					uvs.uvB = *(Vector2*)&mesh.texcoords[idx2 * 2];
+					uvs.uvC = *(Vector2*)&mesh.texcoords[idx3 * 2];
+				}
+
+				geometry->triangles.push_back(tri);
+				geometry->uvs.push_back(uvs);
 			}
 		}
 
-		RaytracingMesh rmesh = { firstTriIndex, mesh.triangleCount, 0, bvhDepth, material, Vector4(bounds.min.x, bounds.min.y, bounds.min.z, 0), Vector4(bounds.max.x, bounds.max.y, bounds.max.z, 0) };
+		RaytracingMesh rmesh = { firstTriIndex, mesh.triangleCount, 0, bvhDepth, materialIndex, { 0, 0, 0 }, Vector4(bounds.min.x, bounds.min.y, bounds.min.z, 0), Vector4(bounds.max.x, bounds.max.y, bounds.max.z, 0) };
 
-		TracingEngine::meshes.push_back(rmesh);
+		geometry->meshes.push_back(rmesh);
 	}
+}
+
+void TracingEngine::UploadRaylibModel(Model model, int materialIndex, bool indexed, int bvhDepth)
+{
+	PROFILE_SCOPE("UploadRaylibModel");
+
+	AppendRaylibModel(&geometry, model, materialIndex, indexed, bvhDepth);
+
+	models.push_back(model);
+}
+
+void TracingEngine::UploadRaylibModel(Model model, bool indexed, int bvhDepth)
+{
+	PROFILE_SCOPE("UploadRaylibModel");
+
+	AppendRaylibModel(&geometry, model, AddRaylibMaterials(model), indexed, bvhDepth);
 
 	models.push_back(model);
 }
 
-void TracingEngine::UploadStaticData()
+bool TracingEngine::FitsBuffers(SceneGeometry* geometry)
 {
+	// the GPU side buffers are fixed size arrays
+	int maxMeshes = sizeof(MeshBuffer) / sizeof(RaytracingMesh);
+	int maxTriangles = sizeof(TriangleBuffer) / sizeof(Triangle);
+	int maxNodes = sizeof(NodeBuffer) / sizeof(Node);
+
+	if (geometry->meshes.size() > maxMeshes)
+	{
+		TraceLog(LOG_ERROR, "TRACING: %i meshes, at most %i fit the mesh buffer", (int)geometry->meshes.size(), maxMeshes);
+		return false;
+	}
+
+	if (geometry->triangles.size() > maxTriangles || geometry->uvs.size() != geometry->triangles.size())
+	{
+		TraceLog(LOG_ERROR, "TRACING: %i triangles with %i UVs, at most %i fit the triangle buffer", (int)geometry->triangles.size(), (int)geometry->uvs.size(), maxTriangles);
+		return false;
+	}
+
+	if (geometry->nodes.size() > maxNodes)
+	{
+		TraceLog(LOG_ERROR, "TRACING: %i BVH nodes, at most %i fit the node buffer", (int)geometry->nodes.size(), maxNodes);
+		return false;
+	}
+
+	return true;
+}
+
+bool TracingEngine::UploadStaticData()
+{
+	PROFILE_SCOPE("UploadStaticData");
+
+	bool fits = true;
+
+	if (spheres.size() > sizeof(SphereBuffer) / sizeof(Sphere))
+	{
+		TraceLog(LOG_ERROR, "TRACING: %i spheres, at most %i fit the sphere buffer", (int)spheres.size(), (int)(sizeof(SphereBuffer) / sizeof(Sphere)));
+		spheres.resize(sizeof(SphereBuffer) / sizeof(Sphere));
+		fits = false;
+	}
+
 	UploadSpheres();
-	UploadSky();
+	UploadMaterials();
+	UploadTextures();
+
+	GenerateBVHS(&geometry);
+
+	// upload nothing rather than overrun the buffers
+	if (!FitsBuffers(&geometry))
+	{
+		geometry = {};
+		fits = false;
+	}
 
-	GenerateBVHS();
 	UploadTriangles();
 	UploadMeshes();
+	UploadNodes();
 
 	UploadSSBOS();
+
+	return fits;
+}
+
+bool TracingEngine::UploadGeometry(SceneGeometry geometry)
+{
+	PROFILE_SCOPE("UploadGeometry");
+
+	if (!FitsBuffers(&geometry))
+	{
+		return false;
+	}
+
+	TracingEngine::geometry = std::move(geometry);
+
+	UploadTriangles();
+	UploadMeshes();
+	UploadNodes();
+
+	UploadSSBOS();
+
+	return true;
 }
 
 void TracingEngine::UploadData(Camera* camera)
 {
+	PROFILE_SCOPE("UploadData");
+
 	float planeHeight = 0.01f * tan(camera->fovy * 0.5f * DEG2RAD) * 2;
 	float planeWidth = planeHeight * (resolution.x / resolution.y);
-	Vector3 viewParams = Vector3(planeWidth, planeHeight, 0.01f);
-	SetShaderValue(raytracingShader, tracingParams.viewParams, &viewParams, SHADER_UNIFORM_VEC3);
+	SetFrameConstant(&frameConstants.viewParams, Vector4(planeWidth, planeHeight, 0.01f, 0));
+
+	// the accumulated image was overwritten by the heatmap, trace the next frame from scratch even while paused
+	bool restart = heatmap == HEATMAP_OFF && previousHeatmap != HEATMAP_OFF;
+	previousHeatmap = heatmap;
+
+	if (restart)
+	{
+		ResetAccumulation();
+	}
 
 	if (denoise)
 	{
-		if (!pause)
+		if (!pause || restart)
 		{
 			numRenderedFrames++;
 		}
@@ -396,38 +827,99 @@ void TracingEngine::UploadData(Camera* camera)
 		numRenderedFrames = 0;
 	}
 
-	SetShaderValue(raytracingShader, tracingParams.numRenderedFrames, &numRenderedFrames, SHADER_UNIFORM_INT);
+	if (heatmap != HEATMAP_OFF)
+	{
+		if (traversalStatsSSBOs[0] == 0)
+		{
+			LoadHeatmapBuffers();
+		}
+
+		// scale the colour ramp to the previous frame so the heatmap stays readable on any scene
+		float averages[] = { traversalStats.averageNodeVisits, traversalStats.averageBoxTests, traversalStats.averageTriangleTests };
+		SetFrameConstant(&frameConstants.heatmapScale, std::max(1.0f, averages[heatmap - 1] * 2.0f));
+	}
+
+	SetFrameConstant(&frameConstants.numRenderedFrames, numRenderedFrames);
 
-	SetShaderValue(raytracingShader, tracingParams.cameraPosition, &camera->position, SHADER_UNIFORM_VEC3);
+	SetFrameConstant(&frameConstants.cameraPosition, Vector4(camera->position.x, camera->position.y, camera->position.z, 0));
 
 	float camDist = 1.0f / (tanf(camera->fovy * 0.5f * DEG2RAD));
 	Vector3 camDir = Vector3Scale(Vector3Normalize(Vector3Subtract(camera->target, camera->position)), camDist);
-	SetShaderValue(raytracingShader, tracingParams.cameraDirection, &(camDir), SHADER_UNIFORM_VEC3);
+	SetFrameConstant(&frameConstants.cameraDirection, Vector4(camDir.x, camDir.y, camDir.z, 0));
 
-	SetShaderValue(raytracingShader, tracingParams.denoise, &denoise, SHADER_UNIFORM_INT);
-	SetShaderValue(raytracingShader, tracingParams.pause, &pause, SHADER_UNIFORM_INT);
+	SetFrameConstant(&frameConstants.denoise, (int)denoise);
+	SetFrameConstant(&frameConstants.pause, (int)(pause && !restart));
+	SetFrameConstant(&frameConstants.heatmap, (int)heatmap);
+	SetFrameConstant(&frameConstants.seed, seed);
 
-	SetShaderValue(postShader, postParams.denoise, &denoise, SHADER_UNIFORM_INT);
+	UploadSky();
+	UploadMaterials();
+	UploadTextures();
+	FlushFrameConstants();
 }
 
-void TracingEngine::Render(Camera* camera)
+void TracingEngine::RenderTracingPass()
 {
+	int statsSlot = -1;
+
+	if (heatmap != HEATMAP_OFF && traversalStatsSSBOs[0] != 0)
+	{
+		statsSlot = traversalStatsFrame % TRAVERSAL_STATS_LATENCY;
+		ReduceTraversalStats(statsSlot);
+	}
+
+	Profiler::BeginGpuZone("raytrace");
+
 	BeginTextureMode(raytracingRenderTexture);
 	ClearBackground(BLACK);
 
 	rlEnableDepthTest();
 	BeginShaderMode(raytracingShader);
 
+	// unit 0 is raylib's, the batch only rebinds that one when it flushes
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+	glActiveTexture(GL_TEXTURE0);
+
 	DrawTextureRec(previouseFrameRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
 	//DrawRectangleRec(Rectangle(0, 0, (float)resolution.x, (float)resolution.y), WHITE);
 
 	EndShaderMode();
 	EndTextureMode();
 
+	Profiler::EndGpuZone("raytrace");
+
+	if (statsSlot != -1)
+	{
+		// the counters are shader atomics, buffer reads and updates only see them after a barrier
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		traversalStatsFences[statsSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		traversalStatsFrame++;
+	}
+}
+
+void TracingEngine::CopyToPreviousFrame()
+{
+	Profiler::BeginGpuZone("frame copy");
+
+	BeginTextureMode(previouseFrameRenderTexture);
+	ClearBackground(WHITE);
+	DrawTextureRec(raytracingRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
+	EndTextureMode();
+
+	Profiler::EndGpuZone("frame copy");
+}
+
+void TracingEngine::Render(Camera* camera)
+{
+	RenderTracingPass();
+
 	BeginDrawing();
 	ClearBackground(BLACK);
 
-	if (denoise && pause)
+	Profiler::BeginGpuZone("present");
+
+	if (denoise && pause && heatmap == HEATMAP_OFF)
 	{
 		BeginShaderMode(postShader);
 		DrawTextureRec(raytracingRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
@@ -438,17 +930,70 @@ void TracingEngine::Render(Camera* camera)
 		DrawTextureRec(raytracingRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
 	}
 
+	Profiler::EndGpuZone("present");
+
 	if (debug)
 	{
 		DrawDebug(camera);
 	}
 
+	if (heatmap != HEATMAP_OFF)
+	{
+		DrawHeatmapStats();
+	}
+
 	EndDrawing();
 
-	BeginTextureMode(previouseFrameRenderTexture);
-	ClearBackground(WHITE);
-	DrawTextureRec(raytracingRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
-	EndTextureMode();
+	CopyToPreviousFrame();
+}
+
+void TracingEngine::ResetAccumulation()
+{
+	// UploadData advances the counter before uploading it, so the next accumulated frame is frame 0 and fully replaces the old image
+	numRenderedFrames = -1;
+}
+
+void TracingEngine::Accumulate()
+{
+	RenderTracingPass();
+	CopyToPreviousFrame();
+}
+
+void TracingEngine::AccumulateTile(int x, int y, int width, int height)
+{
+	// tiles are given top down like images, scissor rects start at the bottom
+	rlEnableScissorTest();
+	rlScissor(x, resolution.y - (y + height), width, height);
+
+	Accumulate();
+
+	rlDisableScissorTest();
+}
+
+std::vector<float> TracingEngine::ReadAccumulation()
+{
+	return ReadAccumulation(0, 0, resolution.x, resolution.y);
+}
+
+std::vector<float> TracingEngine::ReadAccumulation(int x, int y, int width, int height)
+{
+	PROFILE_SCOPE("ReadAccumulation");
+
+	std::vector<float> pixels(width * height * 4);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, raytracingRenderTexture.id);
+	glReadPixels(x, resolution.y - (y + height), width, height, GL_RGBA, GL_FLOAT, pixels.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	// GL rows start at the bottom, images at the top
+	std::vector<float> result(width * height * 4);
+
+	for (int row = 0; row < height; row++)
+	{
+		memcpy(&result[row * width * 4], &pixels[(height - 1 - row) * width * 4], width * 4 * sizeof(float));
+	}
+
+	return result;
 }
 
 void TracingEngine::DrawDebugBounds(PaddedBoundingBox* box, Color color)
@@ -466,11 +1011,11 @@ void TracingEngine::DrawDebug(Camera* camera)
 		DrawSphereWires(spheres[i].position, spheres[i].radius, 10, 10, RED);
 	}
 
-	for (size_t i = 0; i < nodes.size(); i++)
+	for (size_t i = 0; i < geometry.nodes.size(); i++)
 	{
-		if (nodes[i].childIndex == 0)
+		if (geometry.nodes[i].childIndex == 0)
 		{
-			DrawDebugBounds(&nodes[i].bounds, ORANGE);
+			DrawDebugBounds(&geometry.nodes[i].bounds, ORANGE);
 		}
 	}
 
@@ -479,17 +1024,63 @@ void TracingEngine::DrawDebug(Camera* camera)
 	EndMode3D();
 
 	DrawFPS(10, 10);
-	DrawText(TextFormat("triangles: %i", triangles.size()), 10, 30, 20, RED);
-	DrawText(TextFormat("nodes: %i", nodes.size()), 10, 50, 20, RED);
+	DrawText(TextFormat("triangles: %i", geometry.triangles.size()), 10, 30, 20, RED);
+	DrawText(TextFormat("nodes: %i", geometry.nodes.size()), 10, 50, 20, RED);
 
 	if (debug) DrawText("DEBUG MODE ACTIVE", 10, 70, 20, WHITE);
 	if (!pause && denoise) DrawText("TEMPORAL DENOISING ACTIVE", 10, 90, 20, WHITE);
 	if (pause && denoise) DrawText("STATIC DENOISING ACTIVE", 10, 90, 20, WHITE);
 	if (pause && !denoise) DrawText("PAUSED", 10, 90, 20, WHITE);
+
+	Profiler::Draw(10, 120, 700, 250);
+}
+
+void TracingEngine::DrawHeatmapStats()
+{
+	const char* names[] = { "node visits", "box tests", "triangle tests" };
+
+	int y = resolution.y - 90;
+
+	DrawRectangle(10, y, 420, 80, Fade(BLACK, 0.6f));
+	DrawText(TextFormat("HEATMAP: %s", names[heatmap - 1]), 20, y + 8, 20, WHITE);
+	DrawText(TextFormat("node visits: avg %.1f max %u", traversalStats.averageNodeVisits, traversalStats.max.nodeVisits), 20, y + 32, 10, WHITE);
+	DrawText(TextFormat("box tests: avg %.1f max %u", traversalStats.averageBoxTests, traversalStats.max.boxTests), 20, y + 46, 10, WHITE);
+	DrawText(TextFormat("triangle tests: avg %.1f max %u", traversalStats.averageTriangleTests, traversalStats.max.triangleTests), 20, y + 60, 10, WHITE);
 }
 
 void TracingEngine::Unload()
 {
 	UnloadRenderTexture(raytracingRenderTexture);
 	UnloadShader(raytracingShader);
+
+	glDeleteBuffers(1, &frameConstantsUBO);
+	rlUnloadShaderBuffer(materialsSSBO);
+	rlUnloadShaderBuffer(triangleUVsSSBO);
+
+	if (textureArray != 0)
+	{
+		glDeleteTextures(1, &textureArray);
+	}
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		UnloadImage(textures[i]);
+	}
+
+	textures.clear();
+
+	if (traversalStatsSSBOs[0] != 0)
+	{
+		for (int i = 0; i < TRAVERSAL_STATS_LATENCY; i++)
+		{
+			rlUnloadShaderBuffer(traversalStatsSSBOs[i]);
+
+			if (traversalStatsFences[i] != nullptr)
+			{
+				glDeleteSync((GLsync)traversalStatsFences[i]);
+			}
+		}
+	}
+
+	Profiler::Unload();
 }
\ No newline at end of file
@@ -3,27 +3,43 @@
 #include <vector>
 #include <raylib.h>
 
-struct TracingParams
-{
-	int cameraPosition,
-		cameraDirection,
-		screenCenter,
-		viewParams,
-		resolution,
-		currentFrame,
-		previousFrame,
-		numRenderedFrames,
-		raysPerPixel,
-		maxBounces,
-		denoise,
-		blur,
-		pause;
+// material textures live in one mipmapped array whose layers take the size of the largest texture, bigger ones are downscaled
+#define MAX_TEXTURE_SIZE 1024
+#define MAX_TEXTURE_LAYERS 16
+
+// a tree this deep has up to 2^19 - 1 nodes, the most a single mesh can have and still fit NodeBuffer
+#define MAX_BVH_DEPTH 18
+
+// traversal stats are read back this many frames after they were traced, like the profiler's GPU queries
+#define TRAVERSAL_STATS_LATENCY 4
+
+enum HeatmapMode
+{
+	HEATMAP_OFF,
+	HEATMAP_NODE_VISITS,
+	HEATMAP_BOX_TESTS,
+	HEATMAP_TRIANGLE_TESTS
+};
+
+struct TraversalCounters
+{
+	unsigned int nodeVisits;
+	unsigned int boxTests;
+	unsigned int triangleTests;
+	unsigned int padding;
+};
+
+struct TraversalStats
+{
+	float averageNodeVisits;
+	float averageBoxTests;
+	float averageTriangleTests;
+	TraversalCounters max;
 };
 
 struct PostParams
 {
-	int resolution,
-		denoise;
+	int resolution;
 };
 
 struct SkyMaterial
@@ -37,18 +53,54 @@ struct SkyMaterial
 	float sunIntensity;
 };
 
+struct SkyConstants
+{
+	Vector4 skyColorZenith;
+	Vector4 skyColorHorizon;
+	Vector4 groundColor;
+	Vector4 sunColor;
+	Vector3 sunDirection;
+	float sunFocus;
+	float sunIntensity;
+	float padding[3];
+};
+
+// std140 mirror of the FrameConstants uniform block in raytracer_fragment.glsl
+struct FrameConstants
+{
+	Vector4 cameraPosition;
+	Vector4 cameraDirection;
+	Vector4 viewParams;
+	Vector2 resolution;
+	Vector2 screenCenter;
+	int numRenderedFrames;
+	int raysPerPixel;
+	int maxBounces;
+	int denoise;
+	int pause;
+	float blur;
+	int heatmap;
+	float heatmapScale;
+	int seed;
+	int padding[3];
+	SkyConstants sky;
+};
+
 struct RaytracingMaterial
 {
 	Vector4 color;
 	Vector4 emission;
 	Vector4 e_s_b_b;
+	int textureIndex;    // 0 is untextured, otherwise a value returned by AddTexture
+	int padding[3];
 };
 
 struct Sphere
 {
 	Vector3 position;
 	float radius;
-	RaytracingMaterial mat;
+	int materialIndex;
+	int padding[3];
 };
 
 struct Triangle
@@ -67,13 +119,21 @@ struct Triangle
 	float paddingF;
 };
 
+struct TriangleUVs
+{
+	Vector2 uvA;
+	Vector2 uvB;
+	Vector2 uvC;
+};
+
 struct RaytracingMesh
 {
 	int firstTriangleIndex;
 	int numTriangles;
 	int rootNodeIndex;
 	int bvhDepth;
-	RaytracingMaterial material;
+	int materialIndex;
+	int padding[3];
 	Vector4 boundingMin;
 	Vector4 boundingMax;
 };
@@ -105,6 +165,11 @@ struct TriangleBuffer
 	Triangle triangles[500000];
 };
 
+struct TriangleUVBuffer
+{
+	TriangleUVs uvs[500000];
+};
+
 struct MeshBuffer
 {
 	RaytracingMesh meshes[10];
@@ -115,6 +180,20 @@ struct NodeBuffer
 	Node nodes[1000000];
 };
 
+struct MaterialBuffer
+{
+	RaytracingMaterial materials[64];
+};
+
+// CPU side triangles, meshes and BVH nodes of a scene, built independently of the GPU buffers
+struct SceneGeometry
+{
+	std::vector<Triangle> triangles;
+	std::vector<TriangleUVs> uvs;    // one per triangle, kept apart so traversal never fetches them
+	std::vector<RaytracingMesh> meshes;
+	std::vector<Node> nodes;
+};
+
 class TracingEngine
 {
 private:
@@ -123,7 +202,6 @@ private:
 
 	inline static RenderTexture2D raytracingRenderTexture;
 	inline static RenderTexture2D previouseFrameRenderTexture;
-	inline static TracingParams tracingParams;
 	inline static PostParams postParams;
 	inline static Vector2 resolution;
 
@@ -132,22 +210,45 @@ private:
 	inline static int raysPerPixel;
 	inline static float blur;
 
-	inline static std::vector<Node> nodes;
+	inline static SceneGeometry geometry;
 
 	inline static Node root;
 
 	inline static int sphereSSBO;
 	inline static int trianglesSSBO;
+	inline static int triangleUVsSSBO;
 	inline static int meshesSSBO;
 	inline static int nodesSSBO;
+	inline static int materialsSSBO;
+	inline static unsigned int frameConstantsUBO;
+	inline static int traversalStatsSSBOs[TRAVERSAL_STATS_LATENCY] = {};
+	inline static void* traversalStatsFences[TRAVERSAL_STATS_LATENCY] = {};    // GLsync of the frame that last wrote each buffer
+	inline static long long traversalStatsFrame = 0;
+	inline static HeatmapMode previousHeatmap = HEATMAP_OFF;
+
+	inline static std::vector<TraversalCounters> traversalStatsBuffer;
 
 	inline static MeshBuffer meshBuffer;
 	inline static TriangleBuffer triangleBuffer;
 	inline static NodeBuffer nodeBuffer;
-	inline static int totalTriangles = 0;
-	inline static int totalMeshes = 0;
 
 	inline static SphereBuffer sphereBuffer;
+	inline static MaterialBuffer materialBuffer;
+	inline static int totalMaterials = 0;
+
+	inline static unsigned int textureArray = 0;
+	inline static int textureArraySize = 0;
+	inline static int textureArrayLayers = 0;
+	inline static std::vector<Image> textures;    // RGBA8, at their own size until uploaded
+
+	// byte range of frameConstants and element range of materialBuffer changed since the last upload
+	inline static FrameConstants frameConstants;
+	inline static int frameConstantsDirtyBegin = 0;
+	inline static int frameConstantsDirtyEnd = 0;
+	inline static int materialsDirtyBegin = 0;
+	inline static int materialsDirtyEnd = 0;
+	inline static int texturesDirtyBegin = 0;
+	inline static int texturesDirtyEnd = 0;
 
 	static PaddedBoundingBox GetMeshPaddedBoundingBox(Mesh mesh);
 	static void GrowToInclude(PaddedBoundingBox* box, Vector3 point);
@@ -156,22 +257,34 @@ private:
 	static Vector3 BoundingBoxCenter(PaddedBoundingBox* box);
 	static float BoundingBoxCenterOnAxis(PaddedBoundingBox* box, int axis);
 	static float TriangleCenterOnAxis(Triangle* triangle, int axis);
-	static void SplitNode(int parentIndex, int depth, int maxDepth);
+	static void SplitNode(SceneGeometry* geometry, int parentIndex, int depth, int maxDepth);
 
 	static Vector4 ColorToVector4(Color color);
 
-	static void GenerateBVHS();
+	static RenderTexture2D LoadFloatRenderTexture(int width, int height);
 
 	static void UploadSpheres();
 	static void UploadMeshes();
 	static void UploadTriangles();
+	static void UploadNodes();
+
+	template<typename T>
+	static void SetFrameConstant(T* field, T value);
+	static void FlushFrameConstants();
+	static void UploadMaterials();
+	static void UploadTextures();
 
 	static void UploadSky();
 	static void UploadSSBOS();
 
+	static void LoadHeatmapBuffers();
+	static void ReduceTraversalStats(int slot);
+	static void DrawHeatmapStats();
+
+	static void RenderTracingPass();
+	static void CopyToPreviousFrame();
+
 	inline static std::vector<Model> models;
-	inline static std::vector<RaytracingMesh> meshes;
-	inline static std::vector<Triangle> triangles;
 
 public:
 
@@ -180,15 +293,42 @@ public:
 	inline static bool debug = false;
 	inline static bool denoise = false;
 	inline static bool pause = false;
+	inline static HeatmapMode heatmap = HEATMAP_OFF;
+	inline static int seed = 0;
+
+	inline static TraversalStats traversalStats;
 
 	inline static SkyMaterial skyMaterial;
 
 	static void Initialize(Vector2 resolution, int maxBounces, int raysPerPixel, float blur);
 
-	static void UploadRaylibModel(Model model, RaytracingMaterial material, bool indexed, int bvhDepth);
-	static void UploadStaticData();
+	static int AddMaterial(RaytracingMaterial material);
+	static void SetMaterial(int materialIndex, RaytracingMaterial material);
+	static RaytracingMaterial GetMaterial(int materialIndex);
+	static int GetMaterialCount();
+	static int AddRaylibMaterial(Material material);
+	static std::vector<int> AddRaylibMaterials(Model model);
+
+	static int AddTexture(Image image);
+	static const std::vector<Image>& GetTextures();
+
+	static void AppendRaylibModel(SceneGeometry* geometry, Model model, int materialIndex, bool indexed, int bvhDepth);
+	static void AppendRaylibModel(SceneGeometry* geometry, Model model, const std::vector<int>& modelMaterials, bool indexed, int bvhDepth);
+	static void GenerateBVHS(SceneGeometry* geometry);
+
+	static void UploadRaylibModel(Model model, int materialIndex, bool indexed, int bvhDepth);
+	static void UploadRaylibModel(Model model, bool indexed, int bvhDepth);    // keeps the model's own materials and textures
+	static bool FitsBuffers(SceneGeometry* geometry);
+	static bool UploadStaticData();
+	static bool UploadGeometry(SceneGeometry geometry);
 	static void UploadData(Camera* camera);
 	static void Render(Camera* camera);
+
+	static void ResetAccumulation();
+	static void Accumulate();
+	static void AccumulateTile(int x, int y, int width, int height);
+	static std::vector<float> ReadAccumulation();
+	static std::vector<float> ReadAccumulation(int x, int y, int width, int height);
 	static void DrawDebugBounds(PaddedBoundingBox* box, Color color);
 	static void DrawDebug(Camera* camera);
 
@@ -3,14 +3,33 @@
 
 #include "RaylibRaytracer.h"
 #include "Graphics/TracingEngine.h"
+#include "Graphics/Profiler.h"
+#include "Batch/BatchRenderer.h"
+#include "Distributed/Coordinator.h"
+#include "Distributed/Worker.h"
 
 #include <raymath.h>
 #include <raylib.h>
 
 using namespace std;
 
-int main()
+int main(int argc, char** argv)
 {
+	if (BatchRenderer::IsBatchCommand(argc, argv))
+	{
+		return BatchRenderer::Run(argc, argv);
+	}
+
+	if (Coordinator::IsCoordinatorCommand(argc, argv))
+	{
+		return Coordinator::Run(argc, argv);
+	}
+
+	if (Worker::IsWorkerCommand(argc, argv))
+	{
+		return Worker::Run(argc, argv);
+	}
+
 	InitWindow(2048, 1024, "raylib raytracer");
 	SetTargetFPS(80);
 
@@ -29,14 +48,14 @@ int main()
 
 	TracingEngine::skyMaterial = SkyMaterial{ WHITE, SKYBLUE, BROWN, WHITE, Vector3(-0.5f, -1, -0.5f), 1, 0.5 };
 
-	RaytracingMaterial red = { Vector4(1,1,1,1), Vector4(1,0,0,10), Vector4(0,0,0,0) };
-	RaytracingMaterial red2 = { Vector4(1,0.6f,0.6f,0), Vector4(0,0,0,0), Vector4(0,0,0,0) };
-	RaytracingMaterial green = { Vector4(1,1,1,1), Vector4(0,0,1,10), Vector4(0,0,0,0) };
-	RaytracingMaterial blue = { Vector4(1,1,1,1), Vector4(0,1,0,10), Vector4(0,0,0,0) };
-	RaytracingMaterial white = { Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,0,0,0) };
-	RaytracingMaterial grey = { Vector4(0.5f,0.5f,0.5f,1), Vector4(0,0,0,0), Vector4(0,0,0,0) };
-	RaytracingMaterial light = { Vector4(1,0.8f,0.7f,1), Vector4(1,1,1,1.2f), Vector4(0,0,0,0) };
-	RaytracingMaterial metal = { Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,1,0,0) };
+	int red = TracingEngine::AddMaterial({ Vector4(1,1,1,1), Vector4(1,0,0,10), Vector4(0,0,0,0) });
+	int red2 = TracingEngine::AddMaterial({ Vector4(1,0.6f,0.6f,0), Vector4(0,0,0,0), Vector4(0,0,0,0) });
+	int green = TracingEngine::AddMaterial({ Vector4(1,1,1,1), Vector4(0,0,1,10), Vector4(0,0,0,0) });
+	int blue = TracingEngine::AddMaterial({ Vector4(1,1,1,1), Vector4(0,1,0,10), Vector4(0,0,0,0) });
+	int white = TracingEngine::AddMaterial({ Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,0,0,0) });
+	int grey = TracingEngine::AddMaterial({ Vector4(0.5f,0.5f,0.5f,1), Vector4(0,0,0,0), Vector4(0,0,0,0) });
+	int light = TracingEngine::AddMaterial({ Vector4(1,0.8f,0.7f,1), Vector4(1,1,1,1.2f), Vector4(0,0,0,0) });
+	int metal = TracingEngine::AddMaterial({ Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,1,0,0) });
 
 	Model dragon = LoadModel("resources/meshes/monkey.obj");
 	dragon.transform = MatrixTranslate(0, 1, -1);
@@ -69,15 +88,24 @@ int main()
 
 	while (!WindowShouldClose())
 	{
+		Profiler::BeginFrame();
+
 		UpdateCamera(&camera, CAMERA_FREE);
 
 
 		TracingEngine::UploadData(&camera);
 
 		if (IsKeyPressed(KEY_ONE)) TracingEngine::debug = !TracingEngine::debug;
+		if (IsKeyPressed(KEY_TWO)) TracingEngine::heatmap = (HeatmapMode)((TracingEngine::heatmap + 1) % (HEATMAP_TRIANGLE_TESTS + 1));
 		if (IsKeyPressed(KEY_R)) TracingEngine::denoise = !TracingEngine::denoise;
 		if (IsKeyPressed(KEY_P)) TracingEngine::pause = !TracingEngine::pause;
 
+		if (IsKeyPressed(KEY_T))
+		{
+			if (Profiler::IsCapturing()) Profiler::EndCapture("trace.json");
+			else Profiler::BeginCapture();
+		}
+
 		TracingEngine::Render(&camera);
 
 		deltaTime += GetFrameTime();
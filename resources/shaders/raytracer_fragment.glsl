@@ -2,24 +2,10 @@
 
 in vec2 fragTexCoord;
 
-uniform vec3 viewParams;
-uniform vec2 resolution;
-
-uniform vec3 cameraPosition;
-uniform vec3 cameraDirection;
-uniform vec2 screenCenter;
-
 uniform sampler2D texture0;
 
-uniform int numRenderedFrames;
-
-uniform bool denoise;
-uniform bool pause;
-
-uniform int raysPerPixel;
-uniform int maxBounces;
-
-uniform float blur;
+// material textures, one per layer, indexed by RayTracingMaterial.textureIndex - 1
+layout(binding = 1) uniform sampler2DArray materialTextures;
 
 struct SkyMaterial
 {
@@ -38,13 +24,15 @@ struct RayTracingMaterial
 	vec4 emission;
 	float emissionStrength;
 	float smoothness;
+	vec2 padding;
+	int textureIndex;
 };
 
 struct Sphere
 {
 	vec3 position;
 	float radius;
-	RayTracingMaterial material;
+	int materialIndex;
 };
 
 struct Triangle
@@ -57,13 +45,20 @@ struct Triangle
 	vec3 normalC;
 };
 
+struct TriangleUVs
+{
+	vec2 uvA;
+	vec2 uvB;
+	vec2 uvC;
+};
+
 struct Mesh
 {
 	int firstTriangleIndex;
 	int numTriangles;
 	int rootNodeIndex;
 	int bvhDepth;
-	RayTracingMaterial material;
+	int materialIndex;
 	vec3 boundingMin;
 	vec3 boundingMax;
 };
@@ -100,10 +95,51 @@ layout(std430, binding = 4) readonly restrict buffer NodeBuffer
 	Node nodes[];
 };
 
-uniform SkyMaterial skyMaterial;
+// x = node visits, y = box tests, z = triangle tests
+layout(std430, binding = 6) restrict buffer TraversalStatsBuffer
+{
+	uvec4 maxCounts;
+	uvec4 rowTotals[];
+};
+
+layout(std430, binding = 7) readonly restrict buffer MaterialBuffer
+{
+	RayTracingMaterial materials[];
+};
+
+// parallel to triangles, only read for the closest hit of a textured material
+layout(std430, binding = 8) readonly restrict buffer TriangleUVBuffer
+{
+	TriangleUVs triangleUVs[];
+};
+
+layout(std140, binding = 0) uniform FrameConstants
+{
+	vec3 cameraPosition;
+	vec3 cameraDirection;
+	vec3 viewParams;
+	vec2 resolution;
+	vec2 screenCenter;
+
+	int numRenderedFrames;
+	int raysPerPixel;
+	int maxBounces;
+	bool denoise;
+	bool pause;
+	float blur;
+	int heatmap;
+	float heatmapScale;
+	int seed;
+
+	SkyMaterial skyMaterial;
+};
 
 out vec4 out_color;
 
+uint nodeVisits;
+uint boxTests;
+uint triangleTests;
+
 struct Ray
 {
 	vec3 origin;
@@ -117,6 +153,8 @@ struct HitInfo
 	float distance;
 	vec3 hitPoint;
 	vec3 hitNormal;
+	vec2 barycentric;
+	int triangleIndex;
 	RayTracingMaterial material;
 };
 
@@ -155,6 +193,7 @@ HitInfo RayTriangle(Ray ray, Triangle tri)
 	hitInfo.didHit = determinant >= 1E-6 && dst >= 0 && u >= 0 && v >= 0 && w >= 0;
 	hitInfo.hitPoint = ray.origin + ray.direction * dst;
 	hitInfo.hitNormal = normalize(tri.normalA * w + tri.normalB * u + tri.normalC * v);
+	hitInfo.barycentric = vec2(u, v);
 	hitInfo.distance = dst;
 	return hitInfo;
 }
@@ -163,6 +202,7 @@ HitInfo RaySphere(Ray ray, vec3 center, float radius)
 {
 	HitInfo hitInfo;
 	hitInfo.didHit = false;
+	hitInfo.triangleIndex = -1;
 	vec3 offsetRayOrigin = ray.origin - center;
 
 	float a = dot(ray.direction, ray.direction);
@@ -199,7 +239,7 @@ float RayBoundingBox(Ray ray, vec3 boundingMin, vec3 boundingMax) {
 	return didHit ? dstNear : 100000000;
 }
 
-HitInfo RayBVH(Ray ray, int nodeOffset, RayTracingMaterial material)
+HitInfo RayBVH(Ray ray, int nodeOffset)
 {
 	int nodeStack[32];
 	int stackIndex = 0;
@@ -211,18 +251,21 @@ HitInfo RayBVH(Ray ray, int nodeOffset, RayTracingMaterial material)
 	while (stackIndex > 0)
 	{
 		Node node = nodes[nodeStack[--stackIndex]];
+		nodeVisits++;
 
 		if (node.childIndex == 0)
 		{
 			for (int t = node.triangleIndex; t < node.triangleIndex + node.numTriangles; t++)
 			{
 				Triangle tri = triangles[t];
+				triangleTests++;
 
 				HitInfo hitInfo = RayTriangle(ray, tri);
 
 				if (hitInfo.didHit && hitInfo.distance < result.distance)
 				{
 					result = hitInfo;
+					result.triangleIndex = t;
 				}
 			}
 		}
@@ -235,6 +278,7 @@ HitInfo RayBVH(Ray ray, int nodeOffset, RayTracingMaterial material)
 
 			float dstA = RayBoundingBox(ray, childA.bounds.min, childA.bounds.max);
 			float dstB = RayBoundingBox(ray, childB.bounds.min, childB.bounds.max);
+			boxTests += 2;
 
 			bool isNearestA = dstA <= dstB;
 			float dstNear = isNearestA ? dstA : dstB;
@@ -250,13 +294,38 @@ HitInfo RayBVH(Ray ray, int nodeOffset, RayTracingMaterial material)
 	return result;
 }
 
-HitInfo CalculateRayCollision(Ray ray, int bounce)
+vec4 SampleMaterialTexture(HitInfo hit, Ray ray, float pathLength)
+{
+	TriangleUVs uvs = triangleUVs[hit.triangleIndex];
+	Triangle tri = triangles[hit.triangleIndex];
+
+	float w = 1 - hit.barycentric.x - hit.barycentric.y;
+	vec2 uv = uvs.uvA * w + uvs.uvB * hit.barycentric.x + uvs.uvC * hit.barycentric.y;
+
+	// mip from a ray cone, the pixel footprint at the hit against the triangle's texel density.
+	// bounces keep the primary ray's spread, so diffuse paths sample sharper than they need to
+	float worldArea = length(cross(tri.posB - tri.posA, tri.posC - tri.posA));
+	vec2 uvAB = uvs.uvB - uvs.uvA;
+	vec2 uvAC = uvs.uvC - uvs.uvA;
+	float uvArea = abs(uvAB.x * uvAC.y - uvAB.y * uvAC.x);
+	float texelsPerUnit = sqrt(uvArea / max(worldArea, 1E-12)) * textureSize(materialTextures, 0).x;
+
+	float pixelSpread = 1 / (screenCenter.y * length(cameraDirection));
+	float footprint = (pathLength + hit.distance) * pixelSpread / max(abs(dot(ray.direction, hit.hitNormal)), 0.05);
+
+	return textureLod(materialTextures, vec3(uv, hit.material.textureIndex - 1), log2(max(footprint * texelsPerUnit, 1E-6)));
+}
+
+HitInfo CalculateRayCollision(Ray ray, int bounce, float pathLength)
 {
 	HitInfo closestHit;
 	closestHit.didHit = false;
+	closestHit.triangleIndex = -1;
 
 	closestHit.distance = 100000000;
 
+	int materialIndex = 0;
+
 	for (int i = 0; i < spheres.length(); i++)
 	{
 		Sphere sphere = spheres[i];
@@ -265,14 +334,13 @@ HitInfo CalculateRayCollision(Ray ray, int bounce)
 		if (hitInfo.didHit && hitInfo.distance < closestHit.distance)
 		{
 			closestHit = hitInfo;
-			closestHit.material = sphere.material;
+			materialIndex = sphere.materialIndex;
 		}
 	}
 
 	for (int i = 0; i < meshes.length(); i++)
 	{
-		RayTracingMaterial mat = meshes[i].material;
-		HitInfo hit = RayBVH(ray, meshes[i].rootNodeIndex, mat);
+		HitInfo hit = RayBVH(ray, meshes[i].rootNodeIndex);
 
 		if (hit.didHit && hit.distance < closestHit.distance)
 		{
@@ -280,10 +348,20 @@ HitInfo CalculateRayCollision(Ray ray, int bounce)
 			closestHit.distance = hit.distance;
 			closestHit.hitNormal = hit.hitNormal;
 			closestHit.hitPoint = ray.origin + ray.direction * hit.distance;
-			closestHit.material = mat;
+			closestHit.barycentric = hit.barycentric;
+			closestHit.triangleIndex = hit.triangleIndex;
+			materialIndex = meshes[i].materialIndex;
 		}
 	}
 
+	// only the closest hit needs its material, and only a textured one pays for UVs and a sample. spheres have no UVs
+	closestHit.material = materials[materialIndex];
+
+	if (closestHit.didHit && closestHit.material.textureIndex > 0 && closestHit.triangleIndex >= 0)
+	{
+		closestHit.material.color *= SampleMaterialTexture(closestHit, ray, pathLength);
+	}
+
 	return closestHit;
 }
 
@@ -333,12 +411,14 @@ vec3 trace(Ray ray, inout int rngState, int maxBounces)
 	vec3 rayColor = vec3(1);
 
 	vec3 debugNormal = vec3(0);
+	float pathLength = 0;
 
 	for (int i = 0; i <= maxBounces; i++)
 	{
-		HitInfo hitInfo = CalculateRayCollision(ray, i);
+		HitInfo hitInfo = CalculateRayCollision(ray, i, pathLength);
 		if (hitInfo.didHit)
 		{
+			pathLength += hitInfo.distance;
 			ray.origin = hitInfo.hitPoint;
 			vec3 specularDirection = reflect(ray.direction, hitInfo.hitNormal);
 			vec3 diffuseDirection = normalize(hitInfo.hitNormal + randomHemisphereDirection(hitInfo.hitNormal, rngState));
@@ -383,8 +463,39 @@ vec3 drawFrame(Ray ray, inout int rngState, int maxRaysPerPixel, int maxBounces)
 	return total / maxRaysPerPixel;
 }
 
+vec3 heatColor(float t)
+{
+	const vec3 stops[5] = vec3[](vec3(0, 0, 0.5), vec3(0, 0.8, 1), vec3(0.2, 1, 0.2), vec3(1, 1, 0), vec3(1, 0, 0));
+
+	t = clamp(t, 0.0, 1.0) * 4.0;
+	int i = min(int(t), 3);
+	return mix(stops[i], stops[i + 1], t - i);
+}
+
+void drawHeatmap(Ray ray, inout int rngState)
+{
+	// primary rays only, so the counts reflect the BVH rather than where the paths happen to bounce
+	drawFrame(ray, rngState, 1, 0);
+
+	uvec4 counts = uvec4(nodeVisits, boxTests, triangleTests, 0);
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	atomicAdd(rowTotals[pixel.y].x, counts.x);
+	atomicAdd(rowTotals[pixel.y].y, counts.y);
+	atomicAdd(rowTotals[pixel.y].z, counts.z);
+	atomicMax(maxCounts.x, counts.x);
+	atomicMax(maxCounts.y, counts.y);
+	atomicMax(maxCounts.z, counts.z);
+
+	out_color = vec4(heatColor(float(counts[heatmap - 1]) / heatmapScale), 1);
+}
+
 void main()
 {
+	nodeVisits = 0;
+	boxTests = 0;
+	triangleTests = 0;
+
 	vec2 UV = gl_FragCoord.xy / resolution;
 
 	vec2 nCoord = (gl_FragCoord.xy - screenCenter.xy) / screenCenter.y;
@@ -400,7 +511,13 @@ void main()
 
 	int pixelIndex = int(gl_FragCoord.y * gl_FragCoord.x);
 
-	int rngState = pixelIndex + numRenderedFrames * 719393;
+	int rngState = pixelIndex + numRenderedFrames * 719393 + seed * 26699;
+
+	if (heatmap > 0)
+	{
+		drawHeatmap(ray, rngState);
+		return;
+	}
 
 	vec3 render;
 